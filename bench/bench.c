@@ -0,0 +1,342 @@
+// Microbenchmarks for the per-frame animation kernels
+// Prints one CSV row per kernel: kernel,iterations,ns_per_frame,frames_per_s
+//
+// Usage: bench [iterations per kernel]
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../ddf_controller/beat.h"
+#include "../ddf_controller/color.h"
+#include "../ddf_controller/effects.h"
+#include "../ddf_controller/encoder.h"
+#include "../ddf_controller/framecache.h"
+#include "../ddf_controller/oscillator.h"
+#include "../ddf_controller/platform.h"
+#include "../ddf_controller/renderpool.h"
+
+#define DEFAULT_ITERATIONS 1000000
+
+// Results are folded into sink so the kernels can't be optimized away
+volatile uint32_t sink = 0;
+
+void report(const char* kernel, unsigned long iterations, unsigned long long elapsed) {
+	double nsPerFrame = (double) elapsed / iterations;
+	printf("%s,%lu,%.2f,%.0f\n", kernel, iterations, nsPerFrame, 1000000000.0 / nsPerFrame);
+	fflush(stdout);
+}
+
+uint32_t sumRows(struct RGBColor* rowColors) {
+	uint32_t sum = 0;
+	for (uint8_t i = 0; i < LED_ROWS; ++i) {
+		sum += rowColors[i].r + rowColors[i].g + rowColors[i].b;
+	}
+	return sum;
+}
+
+void benchHsvToRgb(unsigned long iterations) {
+	struct HSVColor color = { 0, 1, 0.2 };
+	uint32_t sum = 0;
+	unsigned long long start = getNanos();
+	for (unsigned long i = 0; i < iterations; ++i) {
+		color.h = (double) (i % 360);
+		struct RGBColor result = hsvToRgb(&color);
+		sum += result.r + result.g + result.b;
+	}
+	report("hsvToRgb", iterations, getNanos() - start);
+	sink += sum;
+}
+
+void benchScaleColors(unsigned long iterations) {
+	static struct RGBColor frame[LED_COLS * FULL_LED_ROWS];
+	for (uint32_t i = 0; i < LED_COLS * FULL_LED_ROWS; ++i) {
+		frame[i].r = (uint8_t) i;
+		frame[i].g = (uint8_t) (i >> 3);
+		frame[i].b = (uint8_t) (i >> 6);
+	}
+
+	// Full-resolution frames, so fewer iterations
+	unsigned long numFrames = iterations / 100 + 1;
+	unsigned long long start = getNanos();
+	for (unsigned long i = 0; i < numFrames; ++i) {
+		scaleColors(frame, LED_COLS * FULL_LED_ROWS, (uint16_t) (200 + (i % 100)));
+	}
+	report("scaleColors_full_frame", numFrames, getNanos() - start);
+	sink += frame[numFrames % (LED_COLS * FULL_LED_ROWS)].r;
+}
+
+void benchHsvToRgbBatch(unsigned long iterations) {
+	static uint16_t hues[LED_COLS * FULL_LED_ROWS];
+	static uint8_t saturations[LED_COLS * FULL_LED_ROWS];
+	static uint8_t values[LED_COLS * FULL_LED_ROWS];
+	static struct RGBColor frame[LED_COLS * FULL_LED_ROWS];
+	for (uint32_t i = 0; i < LED_COLS * FULL_LED_ROWS; ++i) {
+		hues[i] = (uint16_t) (i % HUE_RANGE);
+		saturations[i] = 255;
+		values[i] = (uint8_t) i;
+	}
+	struct ColorAdjust adjust = { Q8_ONE, Q8_ONE };
+
+	unsigned long numFrames = iterations / 100 + 1;
+	unsigned long long start = getNanos();
+	for (unsigned long i = 0; i < numFrames; ++i) {
+		adjust.gain = (uint16_t) (200 + (i % 100));
+		hsvToRgbBatch(hues, saturations, values, frame, LED_COLS * FULL_LED_ROWS, &adjust);
+	}
+	report("hsvToRgbBatch_full_frame", numFrames, getNanos() - start);
+	sink += frame[numFrames % (LED_COLS * FULL_LED_ROWS)].g;
+}
+
+void benchOscillator(unsigned long iterations) {
+	struct Oscillator oscillator;
+	initOscillator(&oscillator, 600);
+	int32_t sum = 0;
+	unsigned long long start = getNanos();
+	for (unsigned long i = 0; i < iterations; ++i) {
+		advanceOscillator(&oscillator, (uint32_t) (i % 7));
+		sum += getScaledSine(oscillator.phase, 20, 20) + getScaledCosine(oscillator.phase, 20, 20);
+	}
+	report("oscillator", iterations, getNanos() - start);
+	sink += (uint32_t) sum;
+}
+
+void benchWave(unsigned long iterations, uint32_t numWaves, const char* kernel) {
+	struct RGBColor rowColors[LED_ROWS];
+	struct RGBColor color = { 50, 0, 0 };
+	uint16_t waveBrightnesses[WAVE_SIZE];
+	initWaveBrightnesses(waveBrightnesses);
+
+	// Overlapping waves started within the last 400 ms, rendered at most 500 ms later so none finish
+	struct WavePool pool;
+	initWavePool(&pool);
+	for (uint32_t i = 0; i < numWaves; ++i) {
+		addWave(&pool, (i % 2) ? WAVE_DIR_UP : WAVE_DIR_DOWN, -(long) (i * 400 / numWaves));
+	}
+
+	uint32_t sum = 0;
+	unsigned long long start = getNanos();
+	for (unsigned long i = 0; i < iterations; ++i) {
+		renderWaves(rowColors, &pool, waveBrightnesses, &color, (long) (i % 100));
+		sum += sumRows(rowColors);
+	}
+	report(kernel, iterations, getNanos() - start);
+	sink += sum;
+	destroyWavePool(&pool);
+}
+
+void benchRainbow(unsigned long iterations) {
+	struct RGBColor rowColors[LED_ROWS];
+	uint32_t sum = 0;
+	unsigned long long start = getNanos();
+	for (unsigned long i = 0; i < iterations; ++i) {
+		renderRainbow(rowColors);
+		sum += sumRows(rowColors);
+	}
+	report("renderRainbow", iterations, getNanos() - start);
+	sink += sum;
+}
+
+void benchAlternating(unsigned long iterations) {
+	struct RGBColor rowColors[LED_ROWS];
+	uint32_t sum = 0;
+	unsigned long long start = getNanos();
+	for (unsigned long i = 0; i < iterations; ++i) {
+		renderAlternating(rowColors, (uint32_t) i * PHASE_STEP(600));
+		sum += sumRows(rowColors);
+	}
+	report("renderAlternating", iterations, getNanos() - start);
+	sink += sum;
+}
+
+void benchPong(unsigned long iterations) {
+	struct Paddle paddle1, paddle2;
+	struct Ball ball;
+	resetPongAndScore(&paddle1, &paddle2, &ball);
+
+	uint32_t sum = 0;
+	unsigned long long start = getNanos();
+	for (unsigned long i = 0; i < iterations; ++i) {
+		int8_t direction = ((i / 1000) % 2) ? 1 : -1;
+		sum += stepPong(&paddle1, &paddle2, &ball, direction, -direction, PONG_TICK_US);
+		sum += (uint8_t) ball.x;
+	}
+	report("stepPong", iterations, getNanos() - start);
+	sink += sum;
+}
+
+void benchEncodeAllRows(unsigned long iterations) {
+	struct RGBColor rowColors[LED_ROWS];
+	renderRainbow(rowColors);
+	uint8_t packet[MAX_ROW_PACKET_SIZE];
+
+	uint32_t sum = 0;
+	unsigned long long start = getNanos();
+	for (unsigned long i = 0; i < iterations; ++i) {
+		rowColors[i % LED_ROWS].b = (uint8_t) i;
+		sum += encodeAllRowColors(packet, rowColors) + packet[2 + i % (3 * LED_ROWS)];
+	}
+	report("encodeAllRowColors", iterations, getNanos() - start);
+	sink += sum;
+}
+
+void benchEncodeRowDeltas(unsigned long iterations) {
+	struct RGBColor rowColors[LED_ROWS];
+	renderRainbow(rowColors);
+	uint8_t packet[MAX_ROW_PACKET_SIZE];
+	struct RowEncoder encoder;
+	initRowEncoder(&encoder);
+
+	// A few rows change every frame, as in the wave animation
+	uint32_t sum = 0;
+	unsigned long long start = getNanos();
+	for (unsigned long i = 0; i < iterations; ++i) {
+		for (uint8_t j = 0; j < 4; ++j) {
+			rowColors[(i + 9 * j) % LED_ROWS].r = (uint8_t) i;
+		}
+		sum += encodeRowColors(&encoder, packet, rowColors, 1);
+	}
+	report("encodeRowColors", iterations, getNanos() - start);
+	sink += sum;
+}
+
+void benchEncodeFullRes(unsigned long iterations) {
+	struct RGBColor rowColors[LED_ROWS];
+	struct RGBColor fullResRowColors[FULL_LED_ROWS];
+	uint8_t packet[MAX_ROW_PACKET_SIZE];
+	struct RowEncoder encoder;
+	initRowEncoder(&encoder);
+
+	// Interpolated rainbow with a changing gain, so every frame is sent
+	uint32_t sum = 0;
+	unsigned long long start = getNanos();
+	for (unsigned long i = 0; i < iterations; ++i) {
+		renderRainbow(rowColors);
+		expandRowColors(rowColors, fullResRowColors, 1);
+		scaleColors(fullResRowColors, FULL_LED_ROWS, (uint16_t) (128 + (i % 64) * 2));
+		sum += encodeFullResRowColors(&encoder, packet, fullResRowColors, 1);
+	}
+	report("encodeFullResRowColors", iterations, getNanos() - start);
+	sink += sum;
+}
+
+// Spectrum bars moving a little each frame, so only the tiles around the bar tops are sent
+void benchFindDirtyPixelTiles(unsigned long iterations) {
+	static struct Framebuffer framebuffer;
+	static struct PixelEncoder encoder;
+	initFramebuffer(&framebuffer);
+	initPixelEncoder(&encoder);
+	uint8_t dirtyTiles[NUM_PIXEL_TILES];
+	uint8_t levels[4] = { 200, 120, 80, 40 };
+	struct SpectrumParams params = { levels, 4, { 40, 0, 20 } };
+
+	unsigned long numFrames = iterations / 100 + 1;
+	uint32_t sum = 0;
+	unsigned long long start = getNanos();
+	for (unsigned long i = 0; i < numFrames; ++i) {
+		levels[i % 4] = (uint8_t) (64 + (i * 37) % 128);
+		for (uint16_t j = 0; j < NUM_PIXEL_TILES; ++j) {
+			renderSpectrumTile(&framebuffer.tiles[j], j, &params);
+		}
+		sum += findDirtyPixelTiles(&encoder, &framebuffer, dirtyTiles);
+	}
+	report("findDirtyPixelTiles_spectrum", numFrames, getNanos() - start);
+	sink += sum;
+}
+
+// Full-panel plasma on the render pool, to see how render time scales with threads
+void benchPlasma(unsigned long iterations, uint32_t numThreads, const char* name) {
+	static struct Framebuffer framebuffer;
+	static struct RenderPool pool;
+	startRenderPool(&pool, numThreads);
+	struct PlasmaParams params = { 0, toQ8(0.2) };
+
+	unsigned long numFrames = iterations / 1000 + 1;
+	uint32_t sum = 0;
+	unsigned long long start = getNanos();
+	for (unsigned long i = 0; i < numFrames; ++i) {
+		params.phase += PHASE_STEP(PLASMA_PERIOD_MS);
+		renderTiles(&pool, &framebuffer, renderPlasmaTile, &params);
+		sum += framebuffer.tiles[i % NUM_PIXEL_TILES].pixels[0].r;
+	}
+	report(name, numFrames, getNanos() - start);
+	sink += sum;
+	stopRenderPool(&pool);
+}
+
+// Alternating animation through the frame cache, mostly hits once every phase bucket has been seen
+void benchFrameCache(unsigned long iterations) {
+	struct RGBColor rowColors[LED_ROWS];
+	static struct FrameCache cache;
+	initFrameCache(&cache);
+
+	struct FrameCacheKey key = { 0 };
+	key.animationMode = ANIMATION_ALTERNATING;
+	uint32_t sum = 0;
+	unsigned long long start = getNanos();
+	for (unsigned long i = 0; i < iterations; ++i) {
+		key.phaseBucket = ((uint32_t) i * PHASE_STEP(600)) >> (32 - FRAME_CACHE_PHASE_BITS);
+		struct FrameCacheEntry* entry = lookupFrame(&cache, &key);
+		if (!entry->isValid) {
+			renderAlternating(rowColors, FRAME_CACHE_PHASE(key.phaseBucket));
+			fillFrameCacheEntry(entry, rowColors, 0, Q8_ONE);
+		}
+		sum += entry->packetSize;
+	}
+	report("frameCache_alternating", iterations, getNanos() - start);
+	sink += sum;
+}
+
+// One PCM hop through the FFT and onset detector, a click every 16 hops
+void benchBeat(unsigned long iterations) {
+	static struct BeatDetector detector;
+	initBeatDetector(&detector, 44100);
+	float hop[BEAT_HOP_SIZE];
+	struct AudioFeatures features;
+
+	unsigned long numHops = iterations / 100 + 1;
+	uint32_t sum = 0;
+	unsigned long long start = getNanos();
+	for (unsigned long i = 0; i < numHops; ++i) {
+		for (uint16_t j = 0; j < BEAT_HOP_SIZE; ++j) {
+			hop[j] = (i % 16 == 0 && j < 64) ? 0.5f : 0.01f * (float) ((i * BEAT_HOP_SIZE + j) % 7) - 0.03f;
+		}
+		analyzeHop(&detector, hop, &features);
+		sum += features.isBeat + features.level;
+	}
+	report("analyzeHop", numHops, getNanos() - start);
+	sink += sum;
+}
+
+int main(int argc, char** argv) {
+	unsigned long iterations = (argc > 1) ? strtoul(argv[1], NULL, 10) : DEFAULT_ITERATIONS;
+	if (iterations == 0) {
+		iterations = DEFAULT_ITERATIONS;
+	}
+
+	initSineTable();
+	initPlasmaRingPhases();
+
+	printf("kernel,iterations,ns_per_frame,frames_per_s\n");
+	benchHsvToRgb(iterations);
+	benchScaleColors(iterations);
+	benchHsvToRgbBatch(iterations);
+	benchOscillator(iterations);
+	benchWave(iterations, 4, "renderWaves_4");
+	benchWave(iterations, 32, "renderWaves_32");
+	benchRainbow(iterations);
+	benchAlternating(iterations);
+	benchPong(iterations);
+	benchEncodeAllRows(iterations);
+	benchEncodeRowDeltas(iterations);
+	benchEncodeFullRes(iterations);
+	benchFindDirtyPixelTiles(iterations);
+	benchPlasma(iterations, 1, "renderPlasma_1_thread");
+	benchPlasma(iterations, 2, "renderPlasma_2_threads");
+	benchPlasma(iterations, 4, "renderPlasma_4_threads");
+	benchPlasma(iterations, 0, "renderPlasma_all_threads");
+	benchFrameCache(iterations);
+	benchBeat(iterations);
+
+	return sink == 0xFFFFFFFF;  // Practically always 0, keeps sink live
+}
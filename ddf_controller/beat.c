@@ -0,0 +1,160 @@
+#include <math.h>
+
+#include "beat.h"
+
+#define BEAT_PI 3.14159265358979323846
+
+void initBeatDetector(struct BeatDetector* detector, uint32_t sampleRate) {
+	detector->sampleRate = sampleRate;
+
+	for (uint16_t i = 0; i < BEAT_FFT_SIZE; ++i) {
+		detector->window[i] = (float) (0.5 - 0.5 * cos(2 * BEAT_PI * i / BEAT_FFT_SIZE));
+		detector->input[i] = 0;
+
+		uint16_t reversed = 0;
+		for (uint8_t bit = 0; bit < BEAT_FFT_BITS; ++bit) {
+			reversed |= ((i >> bit) & 1) << (BEAT_FFT_BITS - 1 - bit);
+		}
+		detector->bitReversed[i] = reversed;
+	}
+	for (uint16_t i = 0; i < BEAT_FFT_SIZE / 2; ++i) {
+		detector->cosTable[i] = (float) cos(2 * BEAT_PI * i / BEAT_FFT_SIZE);
+		detector->sinTable[i] = (float) -sin(2 * BEAT_PI * i / BEAT_FFT_SIZE);
+	}
+
+	for (uint16_t i = 0; i < BEAT_NUM_BINS; ++i) {
+		detector->lastLogMagnitudes[i] = 0;
+	}
+	for (uint8_t i = 0; i < BEAT_FLUX_HISTORY; ++i) {
+		detector->fluxHistory[i] = 0;
+	}
+	detector->fluxHistoryIndex = 0;
+
+	double hopMs = 1000.0 * BEAT_HOP_SIZE / sampleRate;
+	detector->minHopsBetweenBeats = (uint32_t) ceil(BEAT_MIN_INTERVAL_MS / hopMs);
+	detector->hopsSinceBeat = detector->minHopsBetweenBeats;
+
+	const uint32_t bandEdgesHz[NUM_AUDIO_BANDS + 1] = AUDIO_BAND_EDGES_HZ;
+	for (uint8_t i = 0; i <= NUM_AUDIO_BANDS; ++i) {
+		uint32_t bin = (uint32_t) ((uint64_t) bandEdgesHz[i] * BEAT_FFT_SIZE / sampleRate);
+		detector->bandEdges[i] = (uint16_t) ((bin < BEAT_NUM_BINS) ? bin : BEAT_NUM_BINS);
+	}
+
+	detector->agcDecay = (float) pow(0.5, hopMs / BEAT_AGC_HALF_LIFE_MS);
+	detector->levelPeak = BEAT_AGC_FLOOR;
+	for (uint8_t i = 0; i < NUM_AUDIO_BANDS; ++i) {
+		detector->bandPeaks[i] = BEAT_AGC_FLOOR;
+	}
+}
+
+// In-place iterative radix-2 FFT of real and imag
+void runFft(struct BeatDetector* detector) {
+	float* real = detector->real;
+	float* imag = detector->imag;
+	for (uint16_t i = 0; i < BEAT_FFT_SIZE; ++i) {
+		uint16_t j = detector->bitReversed[i];
+		if (j > i) {
+			float swap = real[i];
+			real[i] = real[j];
+			real[j] = swap;
+			swap = imag[i];
+			imag[i] = imag[j];
+			imag[j] = swap;
+		}
+	}
+
+	for (uint16_t size = 2; size <= BEAT_FFT_SIZE; size *= 2) {
+		uint16_t halfSize = size / 2;
+		uint16_t tableStep = BEAT_FFT_SIZE / size;
+		for (uint16_t start = 0; start < BEAT_FFT_SIZE; start += size) {
+			for (uint16_t k = 0; k < halfSize; ++k) {
+				float wr = detector->cosTable[k * tableStep];
+				float wi = detector->sinTable[k * tableStep];
+				uint16_t even = start + k;
+				uint16_t odd = even + halfSize;
+				float tr = wr * real[odd] - wi * imag[odd];
+				float ti = wr * imag[odd] + wi * real[odd];
+				real[odd] = real[even] - tr;
+				imag[odd] = imag[even] - ti;
+				real[even] += tr;
+				imag[even] += ti;
+			}
+		}
+	}
+}
+
+// Loudness relative to a slowly decaying peak, 0-255
+uint8_t getAgcLevel(float value, float* peak, float decay) {
+	*peak *= decay;
+	if (*peak < BEAT_AGC_FLOOR) {
+		*peak = BEAT_AGC_FLOOR;
+	}
+	if (value > *peak) {
+		*peak = value;
+	}
+	return (uint8_t) (255 * value / *peak);
+}
+
+void analyzeHop(struct BeatDetector* detector, const float* hop, struct AudioFeatures* features) {
+	// Slide the window by one hop
+	float sumSquares = 0;
+	for (uint16_t i = 0; i < BEAT_HOP_SIZE; ++i) {
+		detector->input[i] = detector->input[i + BEAT_HOP_SIZE];
+		detector->input[i + BEAT_HOP_SIZE] = hop[i];
+		sumSquares += hop[i] * hop[i];
+	}
+	for (uint16_t i = 0; i < BEAT_FFT_SIZE; ++i) {
+		detector->real[i] = detector->input[i] * detector->window[i];
+		detector->imag[i] = 0;
+	}
+	runFft(detector);
+
+	// Spectral flux counts only rising bins, so decays don't register as onsets
+	float flux = 0;
+	float bandEnergies[NUM_AUDIO_BANDS] = { 0 };
+	uint8_t band = 0;
+	for (uint16_t i = 0; i < BEAT_NUM_BINS; ++i) {
+		float energy = detector->real[i] * detector->real[i] + detector->imag[i] * detector->imag[i];
+		float logMagnitude = log1pf(BEAT_LOG_GAIN * sqrtf(energy));
+		float rise = logMagnitude - detector->lastLogMagnitudes[i];
+		if (rise > 0) {
+			flux += rise;
+		}
+		detector->lastLogMagnitudes[i] = logMagnitude;
+
+		while (band < NUM_AUDIO_BANDS && i >= detector->bandEdges[band + 1]) {
+			++band;
+		}
+		if (band < NUM_AUDIO_BANDS && i >= detector->bandEdges[band]) {
+			bandEnergies[band] += energy;
+		}
+	}
+	flux /= BEAT_NUM_BINS;
+
+	// Onsets stand out from the recent flux by several deviations, whatever the noise floor
+	float meanFlux = 0;
+	float meanSquareFlux = 0;
+	for (uint8_t i = 0; i < BEAT_FLUX_HISTORY; ++i) {
+		meanFlux += detector->fluxHistory[i];
+		meanSquareFlux += detector->fluxHistory[i] * detector->fluxHistory[i];
+	}
+	meanFlux /= BEAT_FLUX_HISTORY;
+	meanSquareFlux /= BEAT_FLUX_HISTORY;
+	float fluxDeviation = sqrtf(fmaxf(meanSquareFlux - meanFlux * meanFlux, 0));
+	detector->fluxHistory[detector->fluxHistoryIndex] = flux;
+	detector->fluxHistoryIndex = (detector->fluxHistoryIndex + 1) % BEAT_FLUX_HISTORY;
+
+	++detector->hopsSinceBeat;
+	features->isBeat = 0;
+	if (flux > meanFlux + BEAT_THRESHOLD_DEVIATIONS * fluxDeviation + BEAT_THRESHOLD_OFFSET && detector->hopsSinceBeat >= detector->minHopsBetweenBeats) {
+		features->isBeat = 1;
+		detector->hopsSinceBeat = 0;
+	}
+
+	features->level = getAgcLevel(sqrtf(sumSquares / BEAT_HOP_SIZE), &detector->levelPeak, detector->agcDecay);
+	// Band amplitudes on roughly the same scale as the level, so the AGC floor means the same for both
+	for (uint8_t i = 0; i < NUM_AUDIO_BANDS; ++i) {
+		float bandAmplitude = sqrtf(bandEnergies[i] * 4 / BEAT_FFT_SIZE / BEAT_FFT_SIZE);
+		features->bandLevels[i] = getAgcLevel(bandAmplitude, &detector->bandPeaks[i], detector->agcDecay);
+	}
+}
@@ -0,0 +1,60 @@
+#ifndef BEAT_H
+#define BEAT_H
+
+#include <stdint.h>
+
+// Streaming beat detection and band levels from mono PCM
+// Each hop of BEAT_HOP_SIZE samples is analyzed together with the one before it through a Hann-windowed FFT
+// Beats are onsets in the spectral flux (summed rise of the log magnitude spectrum) above an adaptive threshold
+// Results describe the middle of the window, BEAT_FFT_SIZE / 2 samples (about 12 ms at 44.1 kHz) behind the newest sample
+#define BEAT_FFT_BITS 10
+#define BEAT_FFT_SIZE (1 << BEAT_FFT_BITS)
+#define BEAT_HOP_SIZE (BEAT_FFT_SIZE / 2)
+#define BEAT_NUM_BINS (BEAT_FFT_SIZE / 2 + 1)
+
+#define BEAT_LOG_GAIN 100.0f  // Compresses magnitudes as log(1 + gain * magnitude)
+#define BEAT_FLUX_HISTORY 32  // Hops the threshold averages over, about 0.4 s at 44.1 kHz
+#define BEAT_THRESHOLD_DEVIATIONS 3.0f  // Standard deviations above the mean flux
+#define BEAT_THRESHOLD_OFFSET 0.02f  // Mean flux per bin, keeps steady input from triggering beats
+#define BEAT_MIN_INTERVAL_MS 150  // Refractory period after a beat
+
+#define BEAT_AGC_HALF_LIFE_MS 5000  // Levels are relative to a peak that halves over this long without louder input
+#define BEAT_AGC_FLOOR 0.001f  // About -60 dBFS, quieter input stays near 0
+
+#define NUM_AUDIO_BANDS 4  // Bass, low mids, high mids, treble
+#define AUDIO_BAND_EDGES_HZ { 20, 150, 600, 3000, 12000 }
+
+struct AudioFeatures {
+	uint8_t level;  // Overall loudness, scaled like the Arduino's level byte
+	uint8_t isBeat;
+	uint8_t bandLevels[NUM_AUDIO_BANDS];
+};
+
+struct BeatDetector {
+	uint32_t sampleRate;
+	float window[BEAT_FFT_SIZE];
+	float input[BEAT_FFT_SIZE];  // Newest BEAT_FFT_SIZE samples
+	float real[BEAT_FFT_SIZE];
+	float imag[BEAT_FFT_SIZE];
+	float cosTable[BEAT_FFT_SIZE / 2];
+	float sinTable[BEAT_FFT_SIZE / 2];
+	uint16_t bitReversed[BEAT_FFT_SIZE];
+
+	float lastLogMagnitudes[BEAT_NUM_BINS];
+	float fluxHistory[BEAT_FLUX_HISTORY];
+	uint8_t fluxHistoryIndex;
+	uint32_t hopsSinceBeat;
+	uint32_t minHopsBetweenBeats;
+
+	uint16_t bandEdges[NUM_AUDIO_BANDS + 1];  // FFT bins
+	float agcDecay;  // Per hop
+	float levelPeak;
+	float bandPeaks[NUM_AUDIO_BANDS];
+};
+
+void initBeatDetector(struct BeatDetector* detector, uint32_t sampleRate);
+
+// Analyze the next BEAT_HOP_SIZE samples
+void analyzeHop(struct BeatDetector* detector, const float* hop, struct AudioFeatures* features);
+
+#endif
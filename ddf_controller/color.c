@@ -0,0 +1,225 @@
+#include "color.h"
+
+#if defined(COLOR_USE_AVX2)
+#include <immintrin.h>
+#elif defined(COLOR_USE_SSE2)
+#include <emmintrin.h>
+#endif
+
+#define HSV_BATCH_SIZE 16
+
+uint16_t toQ8(double multiplier) {
+	if (multiplier <= 0) {
+		return 0;
+	}
+	if (multiplier * Q8_ONE >= 0xFFFF) {
+		return 0xFFFF;
+	}
+	return (uint16_t) (multiplier * Q8_ONE);
+}
+
+uint8_t scaleChannel(uint8_t channel, uint16_t gain) {
+	uint32_t scaled = ((uint32_t) channel * gain) >> 8;
+	return (uint8_t) ((scaled > 255) ? 255 : scaled);
+}
+
+void hsvToRgbScalar(uint16_t hue, uint8_t saturation, uint8_t value, struct RGBColor* color, struct ColorAdjust* adjust) {
+	uint16_t s = scaleChannel(saturation, adjust->saturation);
+	uint16_t v = value;
+	uint16_t region = hue >> 8;
+	uint16_t f = hue & 255;
+
+	uint8_t p = (uint8_t) ((v * (255 - s)) >> 8);
+	uint8_t q = (uint8_t) ((v * (255 - ((s * f) >> 8))) >> 8);
+	uint8_t t = (uint8_t) ((v * (255 - ((s * (255 - f)) >> 8))) >> 8);
+
+	uint8_t r, g, b;
+	switch (region) {
+	case 0:
+		r = (uint8_t) v; g = t; b = p;
+		break;
+	case 1:
+		r = q; g = (uint8_t) v; b = p;
+		break;
+	case 2:
+		r = p; g = (uint8_t) v; b = t;
+		break;
+	case 3:
+		r = p; g = q; b = (uint8_t) v;
+		break;
+	case 4:
+		r = t; g = p; b = (uint8_t) v;
+		break;
+	default:
+		r = (uint8_t) v; g = p; b = q;
+		break;
+	}
+
+	color->r = scaleChannel(r, adjust->gain);
+	color->g = scaleChannel(g, adjust->gain);
+	color->b = scaleChannel(b, adjust->gain);
+}
+
+#if defined(COLOR_USE_AVX2)
+
+// min(((x << 8) * gain) >> 16, 255) on unsigned 16-bit lanes holding 8-bit values
+__m256i scaleLanes(__m256i x, __m256i gain) {
+	__m256i scaled = _mm256_mulhi_epu16(_mm256_slli_epi16(x, 8), gain);
+	__m256i clampBias = _mm256_set1_epi16((short) 0xFF00);
+	return _mm256_subs_epu16(_mm256_adds_epu16(scaled, clampBias), clampBias);
+}
+
+__m256i selectLanes(__m256i mask, __m256i a, __m256i b) {
+	return _mm256_or_si256(_mm256_and_si256(mask, a), _mm256_andnot_si256(mask, b));
+}
+
+void scaleColors(struct RGBColor* colors, uint32_t count, uint16_t gain) {
+	uint8_t* bytes = (uint8_t*) colors;
+	uint32_t numBytes = 3 * count;
+	__m256i gainLanes = _mm256_set1_epi16((short) gain);
+	uint32_t i = 0;
+	for (; i + 16 <= numBytes; i += 16) {
+		__m256i x = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) (bytes + i)));
+		x = scaleLanes(x, gainLanes);
+		__m128i packed = _mm_packus_epi16(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+		_mm_storeu_si128((__m128i*) (bytes + i), packed);
+	}
+	for (; i < numBytes; ++i) {
+		bytes[i] = scaleChannel(bytes[i], gain);
+	}
+}
+
+void hsvToRgbBatch(const uint16_t* hues, const uint8_t* saturations, const uint8_t* values, struct RGBColor* colors, uint32_t count, struct ColorAdjust* adjust) {
+	__m256i gain = _mm256_set1_epi16((short) adjust->gain);
+	__m256i saturationGain = _mm256_set1_epi16((short) adjust->saturation);
+	__m256i full = _mm256_set1_epi16(255);
+	uint16_t r[HSV_BATCH_SIZE], g[HSV_BATCH_SIZE], b[HSV_BATCH_SIZE];
+
+	uint32_t i = 0;
+	for (; i + HSV_BATCH_SIZE <= count; i += HSV_BATCH_SIZE) {
+		__m256i h = _mm256_loadu_si256((__m256i*) (hues + i));
+		__m256i s = scaleLanes(_mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) (saturations + i))), saturationGain);
+		__m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) (values + i)));
+		__m256i region = _mm256_srli_epi16(h, 8);
+		__m256i f = _mm256_and_si256(h, full);
+
+		__m256i p = _mm256_srli_epi16(_mm256_mullo_epi16(v, _mm256_sub_epi16(full, s)), 8);
+		__m256i q = _mm256_srli_epi16(_mm256_mullo_epi16(v, _mm256_sub_epi16(full, _mm256_srli_epi16(_mm256_mullo_epi16(s, f), 8))), 8);
+		__m256i t = _mm256_srli_epi16(_mm256_mullo_epi16(v, _mm256_sub_epi16(full, _mm256_srli_epi16(_mm256_mullo_epi16(s, _mm256_sub_epi16(full, f)), 8))), 8);
+
+		__m256i m0 = _mm256_cmpeq_epi16(region, _mm256_set1_epi16(0));
+		__m256i m1 = _mm256_cmpeq_epi16(region, _mm256_set1_epi16(1));
+		__m256i m2 = _mm256_cmpeq_epi16(region, _mm256_set1_epi16(2));
+		__m256i m3 = _mm256_cmpeq_epi16(region, _mm256_set1_epi16(3));
+		__m256i m4 = _mm256_cmpeq_epi16(region, _mm256_set1_epi16(4));
+		__m256i m5 = _mm256_cmpeq_epi16(region, _mm256_set1_epi16(5));
+
+		__m256i rLanes = selectLanes(_mm256_or_si256(m0, m5), v, selectLanes(m1, q, selectLanes(m4, t, p)));
+		__m256i gLanes = selectLanes(_mm256_or_si256(m1, m2), v, selectLanes(m0, t, selectLanes(m3, q, p)));
+		__m256i bLanes = selectLanes(_mm256_or_si256(m3, m4), v, selectLanes(m2, t, selectLanes(m5, q, p)));
+
+		_mm256_storeu_si256((__m256i*) r, scaleLanes(rLanes, gain));
+		_mm256_storeu_si256((__m256i*) g, scaleLanes(gLanes, gain));
+		_mm256_storeu_si256((__m256i*) b, scaleLanes(bLanes, gain));
+		for (uint8_t j = 0; j < HSV_BATCH_SIZE; ++j) {
+			colors[i + j].r = (uint8_t) r[j];
+			colors[i + j].g = (uint8_t) g[j];
+			colors[i + j].b = (uint8_t) b[j];
+		}
+	}
+	for (; i < count; ++i) {
+		hsvToRgbScalar(hues[i], saturations[i], values[i], &colors[i], adjust);
+	}
+}
+
+#elif defined(COLOR_USE_SSE2)
+
+// min(((x << 8) * gain) >> 16, 255) on unsigned 16-bit lanes holding 8-bit values
+__m128i scaleLanes(__m128i x, __m128i gain) {
+	__m128i scaled = _mm_mulhi_epu16(_mm_slli_epi16(x, 8), gain);
+	__m128i clampBias = _mm_set1_epi16((short) 0xFF00);
+	return _mm_subs_epu16(_mm_adds_epu16(scaled, clampBias), clampBias);
+}
+
+__m128i selectLanes(__m128i mask, __m128i a, __m128i b) {
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+void scaleColors(struct RGBColor* colors, uint32_t count, uint16_t gain) {
+	uint8_t* bytes = (uint8_t*) colors;
+	uint32_t numBytes = 3 * count;
+	__m128i gainLanes = _mm_set1_epi16((short) gain);
+	__m128i zero = _mm_setzero_si128();
+	uint32_t i = 0;
+	for (; i + 16 <= numBytes; i += 16) {
+		__m128i x = _mm_loadu_si128((__m128i*) (bytes + i));
+		__m128i low = scaleLanes(_mm_unpacklo_epi8(x, zero), gainLanes);
+		__m128i high = scaleLanes(_mm_unpackhi_epi8(x, zero), gainLanes);
+		_mm_storeu_si128((__m128i*) (bytes + i), _mm_packus_epi16(low, high));
+	}
+	for (; i < numBytes; ++i) {
+		bytes[i] = scaleChannel(bytes[i], gain);
+	}
+}
+
+void hsvToRgbBatch(const uint16_t* hues, const uint8_t* saturations, const uint8_t* values, struct RGBColor* colors, uint32_t count, struct ColorAdjust* adjust) {
+	__m128i gain = _mm_set1_epi16((short) adjust->gain);
+	__m128i saturationGain = _mm_set1_epi16((short) adjust->saturation);
+	__m128i full = _mm_set1_epi16(255);
+	__m128i zero = _mm_setzero_si128();
+	uint16_t r[HSV_BATCH_SIZE], g[HSV_BATCH_SIZE], b[HSV_BATCH_SIZE];
+
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i h = _mm_loadu_si128((__m128i*) (hues + i));
+		__m128i s = scaleLanes(_mm_unpacklo_epi8(_mm_loadl_epi64((__m128i*) (saturations + i)), zero), saturationGain);
+		__m128i v = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i*) (values + i)), zero);
+		__m128i region = _mm_srli_epi16(h, 8);
+		__m128i f = _mm_and_si128(h, full);
+
+		__m128i p = _mm_srli_epi16(_mm_mullo_epi16(v, _mm_sub_epi16(full, s)), 8);
+		__m128i q = _mm_srli_epi16(_mm_mullo_epi16(v, _mm_sub_epi16(full, _mm_srli_epi16(_mm_mullo_epi16(s, f), 8))), 8);
+		__m128i t = _mm_srli_epi16(_mm_mullo_epi16(v, _mm_sub_epi16(full, _mm_srli_epi16(_mm_mullo_epi16(s, _mm_sub_epi16(full, f)), 8))), 8);
+
+		__m128i m0 = _mm_cmpeq_epi16(region, _mm_set1_epi16(0));
+		__m128i m1 = _mm_cmpeq_epi16(region, _mm_set1_epi16(1));
+		__m128i m2 = _mm_cmpeq_epi16(region, _mm_set1_epi16(2));
+		__m128i m3 = _mm_cmpeq_epi16(region, _mm_set1_epi16(3));
+		__m128i m4 = _mm_cmpeq_epi16(region, _mm_set1_epi16(4));
+		__m128i m5 = _mm_cmpeq_epi16(region, _mm_set1_epi16(5));
+
+		__m128i rLanes = selectLanes(_mm_or_si128(m0, m5), v, selectLanes(m1, q, selectLanes(m4, t, p)));
+		__m128i gLanes = selectLanes(_mm_or_si128(m1, m2), v, selectLanes(m0, t, selectLanes(m3, q, p)));
+		__m128i bLanes = selectLanes(_mm_or_si128(m3, m4), v, selectLanes(m2, t, selectLanes(m5, q, p)));
+
+		_mm_storeu_si128((__m128i*) r, scaleLanes(rLanes, gain));
+		_mm_storeu_si128((__m128i*) g, scaleLanes(gLanes, gain));
+		_mm_storeu_si128((__m128i*) b, scaleLanes(bLanes, gain));
+		for (uint8_t j = 0; j < 8; ++j) {
+			colors[i + j].r = (uint8_t) r[j];
+			colors[i + j].g = (uint8_t) g[j];
+			colors[i + j].b = (uint8_t) b[j];
+		}
+	}
+	for (; i < count; ++i) {
+		hsvToRgbScalar(hues[i], saturations[i], values[i], &colors[i], adjust);
+	}
+}
+
+#else
+
+void scaleColors(struct RGBColor* colors, uint32_t count, uint16_t gain) {
+	for (uint32_t i = 0; i < count; ++i) {
+		colors[i].r = scaleChannel(colors[i].r, gain);
+		colors[i].g = scaleChannel(colors[i].g, gain);
+		colors[i].b = scaleChannel(colors[i].b, gain);
+	}
+}
+
+void hsvToRgbBatch(const uint16_t* hues, const uint8_t* saturations, const uint8_t* values, struct RGBColor* colors, uint32_t count, struct ColorAdjust* adjust) {
+	for (uint32_t i = 0; i < count; ++i) {
+		hsvToRgbScalar(hues[i], saturations[i], values[i], &colors[i], adjust);
+	}
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef COLOR_H
+#define COLOR_H
+
+#include <stdint.h>
+
+#include "effects.h"
+
+// Batch color stage for whole row or frame buffers
+// All arithmetic is 8-bit saturating, gains and saturations are Q8 (256 = unchanged)
+// Uses AVX2 or SSE2 when the compiler targets them, otherwise a scalar loop with identical results
+
+#if defined(__AVX2__)
+#define COLOR_USE_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COLOR_USE_SSE2
+#endif
+
+#define HUE_RANGE 1536  // Six 256-step segments
+#define Q8_ONE 256
+
+struct ColorAdjust {
+	uint16_t gain;  // Brightness times audio level
+	uint16_t saturation;
+};
+
+// Q8 factor from a double multiplier, clamped to what the stage can represent
+uint16_t toQ8(double multiplier);
+
+// Multiply every channel by gain
+void scaleColors(struct RGBColor* colors, uint32_t count, uint16_t gain);
+
+// Convert planar HSV (hue in [0, HUE_RANGE)) to RGB, applying saturation before and gain after conversion
+void hsvToRgbBatch(const uint16_t* hues, const uint8_t* saturations, const uint8_t* values, struct RGBColor* colors, uint32_t count, struct ColorAdjust* adjust);
+
+#endif
@@ -0,0 +1,424 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "color.h"
+#include "effects.h"
+#include "oscillator.h"
+
+#define PLASMA_PI 3.14159265358979323846
+
+// Spatial frequencies of the plasma's sine waves, as phase steps per pixel
+#define PLASMA_PHASE_PER_PIXEL(radians) ((uint32_t) ((radians) / (2 * PLASMA_PI) * 4294967296.0))
+#define PLASMA_X_STEP PLASMA_PHASE_PER_PIXEL(0.06)
+#define PLASMA_Y_STEP PLASMA_PHASE_PER_PIXEL(0.09)
+#define PLASMA_DIAGONAL_STEP PLASMA_PHASE_PER_PIXEL(0.04)
+#define PLASMA_RING_RADIANS_PER_PIXEL 0.15
+
+// Ring phase for each whole-pixel offset from the moving center, top 16 bits
+// Covers any offset between two pixels of the tiled panel
+uint16_t plasmaRingPhases[FULL_LED_ROWS][PIXEL_TILE_COLS * PIXEL_TILE_WIDTH];
+
+struct RGBColor hsvToRgb(struct HSVColor* color) {
+	double c = color->v * color->s;
+	double hPrime = color->h / 60.0f;
+	double x = c * (1 - fabs(fmod(hPrime, 2.0) - 1));
+	double r1, g1, b1;
+	if (hPrime >= 5) {
+		r1 = c;
+		g1 = 0;
+		b1 = x;
+	}
+	else if (hPrime >= 4) {
+		r1 = x;
+		g1 = 0;
+		b1 = c;
+	}
+	else if (hPrime >= 3) {
+		r1 = 0;
+		g1 = x;
+		b1 = c;
+	}
+	else if (hPrime >= 2) {
+		r1 = 0;
+		g1 = c;
+		b1 = x;
+	}
+	else if (hPrime >= 1) {
+		r1 = x;
+		g1 = c;
+		b1 = 0;
+	}
+	else {
+		r1 = c;
+		g1 = x;
+		b1 = 0;
+	}
+	double m = color->v - c;
+	struct RGBColor result;
+	result.r = (uint8_t) ((r1 + m) * 255);
+	result.g = (uint8_t) ((g1 + m) * 255);
+	result.b = (uint8_t) ((b1 + m) * 255);
+	return result;
+}
+
+void initWaveBrightnesses(uint16_t* waveBrightnesses) {
+	// Half a sine period across the wave, Q8
+	for (uint8_t i = 0; i < WAVE_SIZE; ++i) {
+		waveBrightnesses[i] = (uint16_t) (getSine(i * (PHASE_HALF / WAVE_SIZE)) >> 7);
+	}
+}
+
+void initWavePool(struct WavePool* pool) {
+	pool->activeWaves = NULL;
+	pool->freeWaves = NULL;
+	pool->blocks = NULL;
+	pool->numActiveWaves = 0;
+}
+
+void destroyWavePool(struct WavePool* pool) {
+	while (pool->blocks) {
+		struct WaveBlock* next = pool->blocks->next;
+		free(pool->blocks);
+		pool->blocks = next;
+	}
+	initWavePool(pool);
+}
+
+uint8_t addWave(struct WavePool* pool, enum WaveDirection direction, long millis) {
+	if (!pool->freeWaves) {
+		struct WaveBlock* block = (struct WaveBlock*) malloc(sizeof(struct WaveBlock));
+		if (!block) {
+			return 0;
+		}
+		block->next = pool->blocks;
+		pool->blocks = block;
+		for (uint8_t i = 0; i < WAVE_BLOCK_SIZE; ++i) {
+			block->waves[i].next = pool->freeWaves;
+			pool->freeWaves = &block->waves[i];
+		}
+	}
+
+	struct WaveData* wave = pool->freeWaves;
+	pool->freeWaves = wave->next;
+
+	wave->animationStartingTime = millis;
+	wave->direction = direction;
+	if (direction == WAVE_DIR_UP) {
+		wave->focus = LED_ROWS - 1;
+	}
+	else {
+		wave->focus = 0;
+	}
+
+	wave->next = pool->activeWaves;
+	pool->activeWaves = wave;
+	++pool->numActiveWaves;
+	return 1;
+}
+
+void renderWaves(struct RGBColor* rowColors, struct WavePool* pool, uint16_t* waveBrightnesses, struct RGBColor* color, long millis) {
+	// Q8 sums of every wave's contribution per channel
+	uint32_t rowSums[3 * LED_ROWS] = { 0 };
+
+	struct WaveData** link = &pool->activeWaves;
+	while (*link) {
+		struct WaveData* wave = *link;
+
+		// Rows covered by the wave, and the brightness index of firstRow
+		int16_t firstRow, lastRow;
+		int16_t brightnessIndex, brightnessStep;
+		uint8_t isFinished;
+		if (wave->direction == WAVE_DIR_DOWN) {
+			wave->focus = (uint8_t)((millis - wave->animationStartingTime) * WAVE_SPEED);
+			isFinished = wave->focus >= LED_ROWS + WAVE_SIZE - 1;
+			firstRow = wave->focus - WAVE_SIZE + 1;
+			lastRow = wave->focus;
+			brightnessIndex = WAVE_SIZE - 1;
+			brightnessStep = -1;
+		}
+		else {
+			wave->focus = LED_ROWS - 1 - (uint8_t)((millis - wave->animationStartingTime) * WAVE_SPEED);
+			isFinished = wave->focus <= -WAVE_SIZE;
+			firstRow = wave->focus;
+			lastRow = wave->focus + WAVE_SIZE - 1;
+			brightnessIndex = 0;
+			brightnessStep = 1;
+		}
+
+		if (isFinished) {
+			*link = wave->next;
+			wave->next = pool->freeWaves;
+			pool->freeWaves = wave;
+			--pool->numActiveWaves;
+			continue;
+		}
+
+		if (firstRow < 0) {
+			brightnessIndex -= brightnessStep * firstRow;
+			firstRow = 0;
+		}
+		if (lastRow > LED_ROWS - 1) {
+			lastRow = LED_ROWS - 1;
+		}
+		for (int16_t j = firstRow; j <= lastRow; ++j) {
+			uint16_t rowBrightness = waveBrightnesses[brightnessIndex];
+			rowSums[3 * j] += color->r * rowBrightness;
+			rowSums[3 * j + 1] += color->g * rowBrightness;
+			rowSums[3 * j + 2] += color->b * rowBrightness;
+			brightnessIndex += brightnessStep;
+		}
+
+		link = &wave->next;
+	}
+
+	for (uint8_t i = 0; i < LED_ROWS; ++i) {
+		uint32_t r = rowSums[3 * i] >> 8;
+		uint32_t g = rowSums[3 * i + 1] >> 8;
+		uint32_t b = rowSums[3 * i + 2] >> 8;
+		rowColors[i].r = (uint8_t) ((r > 255) ? 255 : r);
+		rowColors[i].g = (uint8_t) ((g > 255) ? 255 : g);
+		rowColors[i].b = (uint8_t) ((b > 255) ? 255 : b);
+	}
+}
+
+void renderRainbow(struct RGBColor* rowColors) {
+	int32_t amplitude = 20 * 256;  // Q8, at full gain
+	for (uint8_t i = 0; i < LED_ROWS; ++i) {
+		uint8_t adjustedI = i;//(uint8_t)(i + (millis - animationStartTime) / 12.0);
+		while (adjustedI >= LED_ROWS) {
+			adjustedI -= LED_ROWS;
+		}
+		uint32_t phase = adjustedI * PHASE_STEP(LED_ROWS);
+		if (adjustedI<= LED_ROWS / 3) {
+			uint8_t rising = (uint8_t) (getScaledCosine(phase, amplitude, amplitude) >> 8);
+			uint8_t falling = (uint8_t) (getScaledCosine(phase + PHASE_HALF, amplitude, amplitude) >> 8);
+			rowColors[i].r = rising;
+			rowColors[i].g = falling;
+			rowColors[i].b = 0;
+		}
+		else if (adjustedI <= 2 * LED_ROWS / 3) {
+			phase -= PHASE_THIRD;
+			uint8_t rising = (uint8_t) (getScaledCosine(phase, amplitude, amplitude) >> 8);
+			uint8_t falling = (uint8_t) (getScaledCosine(phase + PHASE_HALF, amplitude, amplitude) >> 8);
+			rowColors[i].r = 0;
+			rowColors[i].g = rising;
+			rowColors[i].b = falling;
+		}
+		else {
+			phase -= 2 * PHASE_THIRD;
+			uint8_t rising = (uint8_t) (getScaledCosine(phase, amplitude, amplitude) >> 8);
+			uint8_t falling = (uint8_t) (getScaledCosine(phase + PHASE_HALF, amplitude, amplitude) >> 8);
+			rowColors[i].r = falling;
+			rowColors[i].g = 0;
+			rowColors[i].b = rising;
+		}
+	}
+}
+
+void renderAlternating(struct RGBColor* rowColors, uint32_t phase) {
+	uint8_t sine1 = (uint8_t) getScaledSine(phase, 20, 20);
+	uint8_t sine2 = (uint8_t) getScaledSine(phase + PHASE_QUARTER, 20, 20);
+	for (uint8_t i = 0; i < LED_ROWS; ++i) {
+		if (i % 2 == 0) {
+			rowColors[i].r = sine1;
+			rowColors[i].g = 0;
+			rowColors[i].b = sine2;
+		}
+		else {
+			rowColors[i].r = sine2;
+			rowColors[i].g = 0;
+			rowColors[i].b = sine1;
+		}
+	}
+}
+
+void initFramebuffer(struct Framebuffer* framebuffer) {
+	for (uint16_t i = 0; i < NUM_PIXEL_TILES; ++i) {
+		framebuffer->tiles[i].header[0] = CMD_BYTE;
+		framebuffer->tiles[i].header[1] = SET_PIXEL_TILE_CODE;
+		framebuffer->tiles[i].header[2] = (uint8_t) i;
+	}
+}
+
+void renderSpectrumTile(struct PixelTile* tile, uint16_t tileIndex, void* context) {
+	struct SpectrumParams* params = (struct SpectrumParams*) context;
+	struct GRBColor off = { 0, 0, 0 };
+	uint16_t tileX = (tileIndex % PIXEL_TILE_COLS) * PIXEL_TILE_WIDTH;
+	uint16_t tileY = (tileIndex / PIXEL_TILE_COLS) * PIXEL_TILE_HEIGHT;
+	for (uint8_t i = 0; i < PIXEL_TILE_WIDTH; ++i) {
+		uint16_t x = tileX + i;
+		uint8_t height = 0;
+		if (x < LED_COLS) {
+			uint8_t bar = (uint8_t) (x * params->numLevels / LED_COLS);
+			uint8_t isGap = (x + 1) * params->numLevels / LED_COLS != bar;  // Last column of each bar
+			height = isGap ? 0 : (uint8_t) ((params->levels[bar] * FULL_LED_ROWS + 127) / 255);
+		}
+		for (uint8_t j = 0; j < PIXEL_TILE_HEIGHT; ++j) {
+			tile->pixels[j * PIXEL_TILE_WIDTH + i] = (tileY + j >= FULL_LED_ROWS - height) ? params->color : off;
+		}
+	}
+}
+
+void initPlasmaRingPhases() {
+	for (uint16_t dy = 0; dy < FULL_LED_ROWS; ++dy) {
+		for (uint16_t dx = 0; dx < PIXEL_TILE_COLS * PIXEL_TILE_WIDTH; ++dx) {
+			double periods = sqrt((double) (dx * dx + dy * dy)) * PLASMA_RING_RADIANS_PER_PIXEL / (2 * PLASMA_PI);
+			plasmaRingPhases[dy][dx] = (uint16_t) ((periods - floor(periods)) * 65536.0);
+		}
+	}
+}
+
+void renderPlasmaTile(struct PixelTile* tile, uint16_t tileIndex, void* context) {
+	struct PlasmaParams* params = (struct PlasmaParams*) context;
+	uint32_t phase = params->phase;
+	uint16_t tileX = (tileIndex % PIXEL_TILE_COLS) * PIXEL_TILE_WIDTH;
+	uint16_t tileY = (tileIndex / PIXEL_TILE_COLS) * PIXEL_TILE_HEIGHT;
+
+	// The ring's center circles the middle of the panel, rounded to whole pixels
+	int32_t centerX = getScaledSine(phase, 30, LED_COLS / 2);
+	int32_t centerY = getScaledCosine(2 * phase, 15, FULL_LED_ROWS / 2);
+
+	// Four sines in Q15 add up to [-4, 4], which maps onto the hue wheel
+	uint16_t hues[PIXEL_TILE_WIDTH * PIXEL_TILE_HEIGHT];
+	for (uint8_t j = 0; j < PIXEL_TILE_HEIGHT; ++j) {
+		uint32_t y = tileY + j;
+		int32_t rowValue = getSine(y * PLASMA_Y_STEP - 2 * phase);
+		const uint16_t* ringPhases = plasmaRingPhases[abs((int32_t) y - centerY)];
+		for (uint8_t i = 0; i < PIXEL_TILE_WIDTH; ++i) {
+			uint32_t x = tileX + i;
+			uint32_t ringPhase = (uint32_t) ringPhases[abs((int32_t) x - centerX)] << 16;
+			int32_t value = rowValue + getSine(x * PLASMA_X_STEP + phase) + getSine((x + y) * PLASMA_DIAGONAL_STEP + 3 * phase) + getSine(ringPhase - 4 * phase);
+			hues[j * PIXEL_TILE_WIDTH + i] = (uint16_t) ((uint32_t) (value + 4 * 32768) * 3 / 512);  // * HUE_RANGE / (8 * 32768)
+		}
+	}
+
+	// Full saturation and value, the brightness is the stage's gain
+	uint8_t saturations[PIXEL_TILE_WIDTH * PIXEL_TILE_HEIGHT];
+	uint8_t values[PIXEL_TILE_WIDTH * PIXEL_TILE_HEIGHT];
+	memset(saturations, 255, sizeof(saturations));
+	memset(values, 255, sizeof(values));
+	struct RGBColor colors[PIXEL_TILE_WIDTH * PIXEL_TILE_HEIGHT];
+	struct ColorAdjust adjust = { params->gain, Q8_ONE };
+	hsvToRgbBatch(hues, saturations, values, colors, PIXEL_TILE_WIDTH * PIXEL_TILE_HEIGHT, &adjust);
+	for (uint8_t i = 0; i < PIXEL_TILE_WIDTH * PIXEL_TILE_HEIGHT; ++i) {
+		tile->pixels[i].g = colors[i].g;
+		tile->pixels[i].r = colors[i].r;
+		tile->pixels[i].b = colors[i].b;
+	}
+}
+
+void expandRowColors(struct RGBColor* rowColors, struct RGBColor* fullResRowColors, uint8_t shouldInterpolate) {
+	for (uint8_t i = 0; i < LED_ROWS; ++i) {
+		fullResRowColors[2 * i] = rowColors[i];
+		if (shouldInterpolate && i < LED_ROWS - 1) {
+			fullResRowColors[2 * i + 1].r = (uint8_t) ((rowColors[i].r + rowColors[i + 1].r + 1) / 2);
+			fullResRowColors[2 * i + 1].g = (uint8_t) ((rowColors[i].g + rowColors[i + 1].g + 1) / 2);
+			fullResRowColors[2 * i + 1].b = (uint8_t) ((rowColors[i].b + rowColors[i + 1].b + 1) / 2);
+		}
+		else {
+			fullResRowColors[2 * i + 1] = rowColors[i];
+		}
+	}
+}
+
+void resetPong(struct Paddle *paddle1, struct Paddle *paddle2, struct Ball *ball, uint8_t serverIs1) {
+	paddle1->y = FULL_LED_ROWS / 2.0 - PADDLE_HEIGHT / 2.0;
+	paddle2->y = FULL_LED_ROWS / 2.0 - PADDLE_HEIGHT / 2.0;
+	ball->x = LED_COLS / 2.0 - BALL_WIDTH / 2.0;
+	ball->y = FULL_LED_ROWS / 2.0 - BALL_WIDTH / 2.0;
+	
+	if (serverIs1) {
+		ball->vx = -BALL_SPEED;
+	}
+	else {
+		ball->vx = BALL_SPEED;
+	}
+	
+	ball->vy = 0;
+}
+
+void resetPongAndScore(struct Paddle* paddle1, struct Paddle* paddle2, struct Ball* ball) {
+	resetPong(paddle1, paddle2, ball, 1);
+	paddle1->score = 0;
+	paddle2->score = 0;
+}
+
+uint8_t stepPong(struct Paddle* paddle1, struct Paddle* paddle2, struct Ball* ball, int8_t paddle1Direction, int8_t paddle2Direction, unsigned long frameTime) {
+	// Control paddles
+	paddle1->y += paddle1Direction * PADDLE_SPEED * frameTime;
+	paddle2->y += paddle2Direction * PADDLE_SPEED * frameTime;
+
+	// Paddle bounds
+	if (paddle1->y < 0) {
+		paddle1->y = 0;
+	}
+	else if (paddle1->y > FULL_LED_ROWS - PADDLE_HEIGHT) {
+		paddle1->y = FULL_LED_ROWS - PADDLE_HEIGHT;
+	}
+	if (paddle2->y < 0) {
+		paddle2->y = 0;
+	}
+	else if (paddle2->y > FULL_LED_ROWS - PADDLE_HEIGHT) {
+		paddle2->y = FULL_LED_ROWS - PADDLE_HEIGHT;
+	}
+
+	// Ball + wall collisions
+	if (ball->y < 0) {
+		ball->y = 0;
+		ball->vy *= -1;
+	}
+	else if (ball->y > FULL_LED_ROWS - BALL_HEIGHT) {
+		ball->y = FULL_LED_ROWS - BALL_HEIGHT;
+		ball->vy *= -1;
+	}
+
+	// Ball + left paddle collisions
+	if (ball->x < PADDLE_WIDTH && ball->y > paddle1->y - BALL_HEIGHT && ball->y < paddle1->y + PADDLE_HEIGHT) {
+		double theta = ((paddle1->y + PADDLE_HEIGHT / 2.0) - (ball->y + BALL_HEIGHT / 2.0)) / (PADDLE_HEIGHT / 2.0) * MAX_BALL_ANGLE;
+		ball->vx = BALL_SPEED * cos(theta);
+		ball->vy = BALL_SPEED * -sin(theta);
+	}
+
+	// Ball + right paddle collisions
+	else if (ball->x > LED_COLS - PADDLE_WIDTH - BALL_WIDTH && ball->y > paddle2->y - BALL_HEIGHT && ball->y < paddle2->y + PADDLE_HEIGHT) {
+		double theta = ((paddle2->y + PADDLE_HEIGHT / 2.0) - (ball->y + BALL_HEIGHT / 2.0)) / (PADDLE_HEIGHT / 2.0) * MAX_BALL_ANGLE;
+		ball->vx = -BALL_SPEED * cos(theta);
+		ball->vy = BALL_SPEED * -sin(theta);
+	}
+
+	uint8_t scoreWasUpdated = 0;
+
+	// Ball past left paddle
+	if (ball->x < 0) {
+		paddle2->score += 4;
+		resetPong(paddle1, paddle2, ball, 0);
+		scoreWasUpdated = 1;
+	}
+
+	// Ball past right paddle
+	else if (ball->x > LED_COLS - BALL_WIDTH) {
+		paddle1->score += 4;
+		resetPong(paddle1, paddle2, ball, 1);
+		scoreWasUpdated = 1;
+	}
+
+	if (scoreWasUpdated) {
+		if (paddle1->score > MAX_PONG_SCORE || paddle2->score > MAX_PONG_SCORE) {
+			resetPongAndScore(paddle1, paddle2, ball);
+		}
+	}
+
+	// Move ball
+	ball->x += ball->vx * frameTime;
+	ball->y += ball->vy * frameTime;
+
+	return scoreWasUpdated;
+}
+
+void quantizePong(struct Paddle* paddle1, struct Paddle* paddle2, struct Ball* ball, uint8_t* pongData) {
+	pongData[0] = (uint8_t) paddle1->y;
+	pongData[1] = (uint8_t) paddle2->y;
+	pongData[2] = (uint8_t) ball->x;
+	pongData[3] = (uint8_t) ball->y;
+}
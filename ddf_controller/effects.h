@@ -0,0 +1,180 @@
+#ifndef EFFECTS_H
+#define EFFECTS_H
+
+#include <stdint.h>
+
+#include "platform.h"
+#include "protocol.h"
+
+// Per-frame animation kernels, kept free of I/O so they can be benchmarked in isolation
+
+// focus = WAVE_SPEED * t
+#define WAVE_SPEED 0.1
+
+#define WAVE_SIZE 16
+#define WAVE_BLOCK_SIZE 32  // Waves allocated at a time when the pool runs out
+
+#define PLASMA_PERIOD_MS 8000
+
+// Pong
+#define PADDLE_WIDTH 5
+#define PADDLE_HEIGHT 16
+#define PADDLE_SPEED 0.00006
+#define BALL_WIDTH 6
+#define BALL_HEIGHT 3
+#define BALL_SPEED 0.000075
+#define MAX_BALL_ANGLE 0.9
+#define MAX_PONG_SCORE 36
+#define PONG_TICK_RATE 1000  // Fixed physics steps per second, independent of the frame rate
+#define PONG_TICK_US (1000000 / PONG_TICK_RATE)
+#define MAX_PONG_LAG_US 100000  // Time beyond this after a stall is skipped rather than simulated
+
+enum ColorMode {
+	RAINBOW,
+	RED,
+	ORANGE,
+	YELLOW,
+	GREEN,
+	BLUE,
+	PURPLE,
+	WHITE,
+	RED_BLUE,
+	GREEN_BLUE
+};
+
+enum AnimationMode {
+	ANIMATION_OFF,
+	ANIMATION_SOLID,
+	ANIMATION_WAVE,
+	ANIMATION_RAINBOW,
+	ANIMATION_ALTERNATING,
+	ANIMATION_PONG,
+	ANIMATION_SPECTRUM,
+	ANIMATION_PLASMA
+};
+
+enum WaveDirection {
+	WAVE_DIR_UP,
+	WAVE_DIR_DOWN
+};
+
+struct RGBColor {
+	uint8_t r;  // [0, 255]
+	uint8_t g;  // [0, 255]
+	uint8_t b;  // [0, 255]
+};
+// Pixel in the order the FPGA expects on the wire
+struct GRBColor {
+	uint8_t g;
+	uint8_t r;
+	uint8_t b;
+};
+
+// One PIXEL_TILE_WIDTH x PIXEL_TILE_HEIGHT tile kept as a ready-to-send SET_PIXEL_TILE_CODE packet,
+// so tiles are written straight from the framebuffer with no staging copy
+// Padded out to four cache lines, so threads rendering different tiles never share a cache line
+struct CACHE_ALIGNED PixelTile {
+	uint8_t header[3];  // CMD_BYTE, SET_PIXEL_TILE_CODE, tile index, set once by initFramebuffer
+	struct GRBColor pixels[PIXEL_TILE_WIDTH * PIXEL_TILE_HEIGHT];  // Row by row
+};
+
+// Full resolution pixels stored tile by tile in the protocol's tile order
+// The last tile column hangs over the right edge of the panel, renderers fill those pixels too
+struct Framebuffer {
+	struct PixelTile tiles[NUM_PIXEL_TILES];
+};
+
+struct HSVColor {
+	double h;  // [0, 360]
+	double s;  // [0, 1]
+	double v;  // [0, 1]
+};
+
+struct WaveData {
+	int16_t focus;
+	long animationStartingTime;
+	enum WaveDirection direction;
+	struct WaveData* next;
+};
+
+struct WaveBlock {
+	struct WaveData waves[WAVE_BLOCK_SIZE];
+	struct WaveBlock* next;
+};
+
+// Waves live in blocks that are never freed, finished waves go back on the free list
+struct WavePool {
+	struct WaveData* activeWaves;
+	struct WaveData* freeWaves;
+	struct WaveBlock* blocks;
+	uint32_t numActiveWaves;
+};
+
+struct Paddle {
+	uint8_t score;
+	double y;
+	struct RGBColor color;
+};
+
+struct Ball {
+	double x, y;
+	double vx, vy;
+	struct RGBColor color;
+};
+
+struct RGBColor hsvToRgb(struct HSVColor* color);
+
+// Animations sample the fixed-point oscillators in oscillator.h, initSineTable must be called first
+void initWaveBrightnesses(uint16_t* waveBrightnesses);  // Q8
+
+void initWavePool(struct WavePool* pool);
+void destroyWavePool(struct WavePool* pool);
+
+// Returns 0 if no memory was left for the wave
+uint8_t addWave(struct WavePool* pool, enum WaveDirection direction, long millis);
+
+// Composite all active waves into rowColors, releasing finished ones
+// Overlapping waves add up and saturate instead of wrapping
+void renderWaves(struct RGBColor* rowColors, struct WavePool* pool, uint16_t* waveBrightnesses, struct RGBColor* color, long millis);
+
+void renderRainbow(struct RGBColor* rowColors);  // At full gain
+void renderAlternating(struct RGBColor* rowColors, uint32_t phase);  // Phase from a 600 ms oscillator
+
+// Write every tile's packet header, renderers only touch the pixels
+void initFramebuffer(struct Framebuffer* framebuffer);
+
+// Per-pixel kernels render one tile of a Framebuffer, context points at the matching parameters
+// Tiles can be rendered in any order and on any thread, see renderpool.h
+typedef void (*TileRenderFunc)(struct PixelTile* tile, uint16_t tileIndex, void* context);
+
+// One bar per level (0-255) across the panel, rising from the bottom, with a column gap between bars
+struct SpectrumParams {
+	uint8_t* levels;
+	uint8_t numLevels;
+	struct GRBColor color;
+};
+void renderSpectrumTile(struct PixelTile* tile, uint16_t tileIndex, void* context);
+
+// Interfering sine waves mapped onto the hue wheel, sampled from the sine table in fixed point
+// initPlasmaRingPhases must be called once first
+struct PlasmaParams {
+	uint32_t phase;  // From a PLASMA_PERIOD_MS oscillator
+	uint16_t gain;  // Q8 brightness of the fully saturated colors, see toQ8
+};
+void initPlasmaRingPhases();
+void renderPlasmaTile(struct PixelTile* tile, uint16_t tileIndex, void* context);
+
+// Scale LED_ROWS rowColors up to FULL_LED_ROWS, blending neighbouring rows or doubling each row
+void expandRowColors(struct RGBColor* rowColors, struct RGBColor* fullResRowColors, uint8_t shouldInterpolate);
+
+void resetPong(struct Paddle* paddle1, struct Paddle* paddle2, struct Ball* ball, uint8_t serverIs1);
+void resetPongAndScore(struct Paddle* paddle1, struct Paddle* paddle2, struct Ball* ball);
+
+// Advance pong by frameTime microseconds, paddle directions are -1 (up), 0 or 1 (down)
+// Returns 1 if a point was scored
+uint8_t stepPong(struct Paddle* paddle1, struct Paddle* paddle2, struct Ball* ball, int8_t paddle1Direction, int8_t paddle2Direction, unsigned long frameTime);
+
+// Positions as sent to the FPGA: paddle 1 y, paddle 2 y, ball x, ball y
+void quantizePong(struct Paddle* paddle1, struct Paddle* paddle2, struct Ball* ball, uint8_t* pongData);
+
+#endif
@@ -0,0 +1,448 @@
+#include <string.h>
+
+#include "encoder.h"
+
+void initRowEncoder(struct RowEncoder* encoder) {
+	encoder->sentRowColorsValid = 0;
+	encoder->keyframeTimeNanos = 0;
+	encoder->paletteSize = 0;
+}
+
+void invalidateRowEncoder(struct RowEncoder* encoder) {
+	encoder->sentRowColorsValid = 0;
+}
+
+// Unchanged frames send nothing, so keyframes follow the clock rather than the number of writes
+uint8_t isRowKeyframeDue(struct RowEncoder* encoder) {
+	return !USE_ROW_DELTAS || !encoder->sentRowColorsValid || getNanos() - encoder->keyframeTimeNanos >= ROW_KEYFRAME_INTERVAL_MS * 1000000ULL;
+}
+
+uint8_t rowColorsEqual(struct RGBColor* a, struct RGBColor* b) {
+	return a->r == b->r && a->g == b->g && a->b == b->b;
+}
+
+uint16_t encodeAllRowColors(uint8_t* packet, struct RGBColor* colors) {
+	packet[0] = CMD_BYTE;
+	packet[1] = SET_ROWS_COLOR_CODE;
+	for (uint8_t i = 0; i < LED_ROWS; ++i) {
+		packet[3 * i + 2] = colors[i].g;
+		packet[3 * i + 3] = colors[i].r;
+		packet[3 * i + 4] = colors[i].b;
+	}
+	return FULL_ROWS_PACKET_SIZE;
+}
+
+// Find the row ranges that changed since the shadow copy, returns how many there are
+// rangesSize is what sending them as range packets costs
+// Ranges separated by a gap cheaper to resend than a new range header are merged
+uint8_t findChangedRowRanges(struct RGBColor* colors, struct RGBColor* sentColors, uint8_t numRows, uint8_t* rangeStarts, uint8_t* rangeCounts, uint16_t* rangesSize) {
+	uint8_t numRanges = 0;
+	uint8_t lastChangedRow = 0;
+	*rangesSize = 0;
+	for (uint8_t i = 0; i < numRows; ++i) {
+		if (rowColorsEqual(&colors[i], &sentColors[i])) {
+			continue;
+		}
+		if (numRanges > 0 && 3 * (i - lastChangedRow - 1) < ROW_RANGE_HEADER_SIZE) {
+			*rangesSize += 3 * (i - lastChangedRow);
+			rangeCounts[numRanges - 1] = i - rangeStarts[numRanges - 1] + 1;
+		}
+		else {
+			*rangesSize += ROW_RANGE_HEADER_SIZE + 3;
+			rangeStarts[numRanges] = i;
+			rangeCounts[numRanges] = 1;
+			++numRanges;
+		}
+		lastChangedRow = i;
+	}
+	return numRanges;
+}
+
+// All ranges go out in a single write
+uint16_t encodeRowRanges(uint8_t* packet, uint8_t code, struct RGBColor* colors, uint8_t* rangeStarts, uint8_t* rangeCounts, uint8_t numRanges) {
+	uint16_t packetSize = 0;
+	for (uint8_t i = 0; i < numRanges; ++i) {
+		packet[packetSize++] = CMD_BYTE;
+		packet[packetSize++] = code;
+		packet[packetSize++] = rangeStarts[i];
+		packet[packetSize++] = rangeCounts[i];
+		for (uint8_t j = rangeStarts[i]; j < rangeStarts[i] + rangeCounts[i]; ++j) {
+			packet[packetSize++] = colors[j].g;
+			packet[packetSize++] = colors[j].r;
+			packet[packetSize++] = colors[j].b;
+		}
+	}
+	return packetSize;
+}
+
+uint16_t encodeRowColors(struct RowEncoder* encoder, uint8_t* packet, struct RGBColor* colors, uint8_t isRangeSupported) {
+	if (isRowKeyframeDue(encoder)) {
+		for (uint8_t i = 0; i < LED_ROWS; ++i) {
+			encoder->sentRowColors[i] = colors[i];
+		}
+		encoder->sentRowColorsValid = 1;
+		encoder->keyframeTimeNanos = getNanos();
+		return encodeAllRowColors(packet, colors);
+	}
+
+	uint8_t rangeStarts[LED_ROWS];
+	uint8_t rangeCounts[LED_ROWS];
+	uint16_t rangesSize;
+	uint8_t numRanges = findChangedRowRanges(colors, encoder->sentRowColors, LED_ROWS, rangeStarts, rangeCounts, &rangesSize);
+	if (numRanges == 0) {
+		// Frame is unchanged, nothing to send
+		return 0;
+	}
+
+	for (uint8_t i = 0; i < LED_ROWS; ++i) {
+		encoder->sentRowColors[i] = colors[i];
+	}
+
+	if (!isRangeSupported || rangesSize >= FULL_ROWS_PACKET_SIZE) {
+		return encodeAllRowColors(packet, colors);
+	}
+	return encodeRowRanges(packet, SET_ROW_RANGE_COLOR_CODE, colors, rangeStarts, rangeCounts, numRanges);
+}
+
+uint8_t getNumRuns(struct RGBColor* colors) {
+	uint8_t numRuns = 1;
+	for (uint8_t i = 1; i < FULL_LED_ROWS; ++i) {
+		if (!rowColorsEqual(&colors[i], &colors[i - 1])) {
+			++numRuns;
+		}
+	}
+	return numRuns;
+}
+
+uint8_t isDelta(int16_t delta) {
+	return delta >= FULL_RES_DELTA_MIN && delta <= FULL_RES_DELTA_MAX;
+}
+
+uint8_t deltasFit(struct RGBColor* colors) {
+	for (uint8_t i = 1; i < FULL_LED_ROWS; ++i) {
+		if (!isDelta(colors[i].g - colors[i - 1].g) || !isDelta(colors[i].r - colors[i - 1].r) || !isDelta(colors[i].b - colors[i - 1].b)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// Whether the frame is a half resolution frame with every row doubled
+uint8_t isHalfRes(struct RGBColor* colors) {
+	for (uint8_t i = 0; i < LED_ROWS; ++i) {
+		if (!rowColorsEqual(&colors[2 * i], &colors[2 * i + 1])) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+uint16_t encodeFullResRows(uint8_t* packet, struct RGBColor* colors) {
+	packet[0] = CMD_BYTE;
+	packet[1] = SET_FULL_RES_ROWS_CODE;
+	for (uint8_t i = 0; i < FULL_LED_ROWS; ++i) {
+		packet[3 * i + 2] = colors[i].g;
+		packet[3 * i + 3] = colors[i].r;
+		packet[3 * i + 4] = colors[i].b;
+	}
+	return FULL_RES_ROWS_PACKET_SIZE;
+}
+
+uint16_t encodeFullResRle(uint8_t* packet, struct RGBColor* colors) {
+	packet[0] = CMD_BYTE;
+	packet[1] = SET_FULL_RES_RLE_CODE;
+	uint16_t packetSize = FULL_RES_RLE_HEADER_SIZE;
+	uint8_t numRuns = 0;
+	uint8_t runStart = 0;
+	for (uint8_t i = 1; i <= FULL_LED_ROWS; ++i) {
+		if (i < FULL_LED_ROWS && rowColorsEqual(&colors[i], &colors[runStart])) {
+			continue;
+		}
+		packet[packetSize++] = i - runStart;
+		packet[packetSize++] = colors[runStart].g;
+		packet[packetSize++] = colors[runStart].r;
+		packet[packetSize++] = colors[runStart].b;
+		++numRuns;
+		runStart = i;
+	}
+	packet[2] = numRuns;
+	return packetSize;
+}
+
+uint16_t encodeFullResDeltas(uint8_t* packet, struct RGBColor* colors) {
+	packet[0] = CMD_BYTE;
+	packet[1] = SET_FULL_RES_DELTA_CODE;
+	packet[2] = colors[0].g;
+	packet[3] = colors[0].r;
+	packet[4] = colors[0].b;
+
+	uint16_t numNibbles = 0;
+	for (uint8_t i = 1; i < FULL_LED_ROWS; ++i) {
+		int16_t deltas[3] = {
+			colors[i].g - colors[i - 1].g,
+			colors[i].r - colors[i - 1].r,
+			colors[i].b - colors[i - 1].b
+		};
+		for (uint8_t j = 0; j < 3; ++j) {
+			uint8_t nibble = (uint8_t) (deltas[j] & 0x0F);
+			if (numNibbles % 2 == 0) {
+				packet[5 + numNibbles / 2] = nibble << 4;
+			}
+			else {
+				packet[5 + numNibbles / 2] |= nibble;
+			}
+			++numNibbles;
+		}
+	}
+	return FULL_RES_DELTA_PACKET_SIZE;
+}
+
+// Fill indices with each row's palette entry, 0 if a row's color is missing from the palette
+uint8_t findPaletteIndices(struct RGBColor* palette, uint8_t paletteSize, struct RGBColor* colors, uint8_t* indices) {
+	for (uint8_t i = 0; i < FULL_LED_ROWS; ++i) {
+		uint8_t j = 0;
+		while (j < paletteSize && !rowColorsEqual(&colors[i], &palette[j])) {
+			++j;
+		}
+		if (j == paletteSize) {
+			return 0;
+		}
+		indices[i] = j;
+	}
+	return 1;
+}
+
+// Collect the distinct colors of a frame into palette and fill indices, 0 if there are more than maxPaletteSize
+uint8_t buildPalette(struct RGBColor* palette, uint8_t maxPaletteSize, struct RGBColor* colors, uint8_t* indices) {
+	uint8_t paletteSize = 0;
+	for (uint8_t i = 0; i < FULL_LED_ROWS; ++i) {
+		uint8_t j = 0;
+		while (j < paletteSize && !rowColorsEqual(&colors[i], &palette[j])) {
+			++j;
+		}
+		if (j == paletteSize) {
+			if (paletteSize == maxPaletteSize) {
+				return 0;
+			}
+			palette[paletteSize++] = colors[i];
+		}
+		indices[i] = j;
+	}
+	return paletteSize;
+}
+
+uint16_t getIndexedRowsPacketSize(uint8_t paletteSize) {
+	return (paletteSize <= MAX_PALETTE_4_SIZE) ? INDEXED_ROWS_4_PACKET_SIZE : INDEXED_ROWS_8_PACKET_SIZE;
+}
+
+uint16_t encodePalette(uint8_t* packet, struct RGBColor* palette, uint8_t paletteSize) {
+	packet[0] = CMD_BYTE;
+	packet[1] = SET_PALETTE_CODE;
+	packet[2] = paletteSize;
+	for (uint8_t i = 0; i < paletteSize; ++i) {
+		packet[3 * i + 3] = palette[i].g;
+		packet[3 * i + 4] = palette[i].r;
+		packet[3 * i + 5] = palette[i].b;
+	}
+	return PALETTE_HEADER_SIZE + 3 * paletteSize;
+}
+
+uint16_t encodeIndexedRows(uint8_t* packet, uint8_t* indices, uint8_t paletteSize) {
+	packet[0] = CMD_BYTE;
+	if (paletteSize <= MAX_PALETTE_4_SIZE) {
+		packet[1] = SET_INDEXED_ROWS_4_CODE;
+		for (uint8_t i = 0; i < FULL_LED_ROWS / 2; ++i) {
+			packet[i + 2] = (indices[2 * i] << 4) | indices[2 * i + 1];
+		}
+		return INDEXED_ROWS_4_PACKET_SIZE;
+	}
+	packet[1] = SET_INDEXED_ROWS_8_CODE;
+	for (uint8_t i = 0; i < FULL_LED_ROWS; ++i) {
+		packet[i + 2] = indices[i];
+	}
+	return INDEXED_ROWS_8_PACKET_SIZE;
+}
+
+// Smallest encoding of a full resolution frame, given the palette the FPGA holds (paletteSize 0 for none)
+// Every encoding stands on its own, only indexed rows depend on the palette
+// If a new palette is uploaded, palette and paletteSize are replaced with it
+uint16_t encodeFullResFrame(uint8_t* packet, struct RGBColor* colors, struct RGBColor* palette, uint8_t* paletteSize) {
+	// Pick the smallest encoding for this frame
+	uint8_t code = SET_FULL_RES_ROWS_CODE;
+	uint16_t packetSize = FULL_RES_ROWS_PACKET_SIZE;
+	uint16_t rleSize = FULL_RES_RLE_HEADER_SIZE + FULL_RES_RLE_RUN_SIZE * getNumRuns(colors);
+	if (rleSize < packetSize) {
+		code = SET_FULL_RES_RLE_CODE;
+		packetSize = rleSize;
+	}
+	if (FULL_RES_DELTA_PACKET_SIZE < packetSize && deltasFit(colors)) {
+		code = SET_FULL_RES_DELTA_CODE;
+		packetSize = FULL_RES_DELTA_PACKET_SIZE;
+	}
+	if (FULL_ROWS_PACKET_SIZE < packetSize && isHalfRes(colors)) {
+		code = SET_ROWS_COLOR_CODE;
+		packetSize = FULL_ROWS_PACKET_SIZE;
+	}
+
+	// Indexed frames reuse the FPGA's palette when every color is in it
+	// Otherwise a new palette is uploaded in the same write if that is still smaller than the best raw encoding
+	uint8_t indices[FULL_LED_ROWS];
+	if (*paletteSize && findPaletteIndices(palette, *paletteSize, colors, indices)) {
+		if (getIndexedRowsPacketSize(*paletteSize) < packetSize) {
+			return encodeIndexedRows(packet, indices, *paletteSize);
+		}
+	}
+	else if (packetSize > PALETTE_HEADER_SIZE + 3 + INDEXED_ROWS_4_PACKET_SIZE) {
+		// Give up as soon as the palette alone makes this the larger option
+		uint16_t maxPaletteSize = (packetSize - PALETTE_HEADER_SIZE - INDEXED_ROWS_4_PACKET_SIZE) / 3;
+		if (maxPaletteSize > MAX_PALETTE_SIZE) {
+			maxPaletteSize = MAX_PALETTE_SIZE;
+		}
+		struct RGBColor newPalette[MAX_PALETTE_SIZE];
+		uint8_t newPaletteSize = buildPalette(newPalette, (uint8_t) maxPaletteSize, colors, indices);
+		if (newPaletteSize && PALETTE_HEADER_SIZE + 3 * newPaletteSize + getIndexedRowsPacketSize(newPaletteSize) < packetSize) {
+			for (uint8_t i = 0; i < newPaletteSize; ++i) {
+				palette[i] = newPalette[i];
+			}
+			*paletteSize = newPaletteSize;
+			uint16_t palettePacketSize = encodePalette(packet, newPalette, newPaletteSize);
+			return palettePacketSize + encodeIndexedRows(packet + palettePacketSize, indices, newPaletteSize);
+		}
+	}
+
+	switch (code) {
+	case SET_FULL_RES_RLE_CODE:
+		return encodeFullResRle(packet, colors);
+	case SET_FULL_RES_DELTA_CODE:
+		return encodeFullResDeltas(packet, colors);
+	case SET_ROWS_COLOR_CODE: {
+		struct RGBColor halfResColors[LED_ROWS];
+		for (uint8_t i = 0; i < LED_ROWS; ++i) {
+			halfResColors[i] = colors[2 * i];
+		}
+		return encodeAllRowColors(packet, halfResColors);
+	}
+	default:
+		return encodeFullResRows(packet, colors);
+	}
+}
+
+uint16_t encodeFullResRowColors(struct RowEncoder* encoder, uint8_t* packet, struct RGBColor* colors, uint8_t isRangeSupported) {
+	uint8_t rangeStarts[FULL_LED_ROWS];
+	uint8_t rangeCounts[FULL_LED_ROWS];
+	uint16_t rangesSize = 0;
+	uint8_t numRanges = 0;
+	if (isRowKeyframeDue(encoder)) {
+		encoder->sentRowColorsValid = 1;
+		encoder->keyframeTimeNanos = getNanos();
+		encoder->paletteSize = 0;  // Resend the palette with keyframes too
+	}
+	else {
+		numRanges = findChangedRowRanges(colors, encoder->sentRowColors, FULL_LED_ROWS, rangeStarts, rangeCounts, &rangesSize);
+		if (numRanges == 0) {
+			return 0;
+		}
+	}
+
+	for (uint8_t i = 0; i < FULL_LED_ROWS; ++i) {
+		encoder->sentRowColors[i] = colors[i];
+	}
+
+	// Only the changed rows go out when that beats the best encoding of the whole frame
+	// The whole frame may upload a new palette, which the FPGA only gets if that encoding is sent
+	struct RGBColor palette[MAX_PALETTE_SIZE];
+	uint8_t paletteSize = encoder->paletteSize;
+	memcpy(palette, encoder->palette, sizeof(palette));
+	uint16_t packetSize = encodeFullResFrame(packet, colors, palette, &paletteSize);
+	if (isRangeSupported && numRanges && rangesSize < packetSize) {
+		return encodeRowRanges(packet, SET_FULL_RES_RANGE_CODE, colors, rangeStarts, rangeCounts, numRanges);
+	}
+	memcpy(encoder->palette, palette, sizeof(palette));
+	encoder->paletteSize = paletteSize;
+	return packetSize;
+}
+
+uint16_t encodeFullResKeyframe(uint8_t* packet, struct RGBColor* colors, struct RGBColor* palette, uint8_t* paletteSize) {
+	*paletteSize = 0;
+	return encodeFullResFrame(packet, colors, palette, paletteSize);
+}
+
+uint8_t markFullResKeyframeSent(struct RowEncoder* encoder, struct RGBColor* colors, struct RGBColor* palette, uint8_t paletteSize) {
+	// Unchanged cached frames are still resent when a keyframe is due
+	if (!isRowKeyframeDue(encoder)) {
+		uint8_t isChanged = 0;
+		for (uint8_t i = 0; i < FULL_LED_ROWS && !isChanged; ++i) {
+			isChanged = !rowColorsEqual(&colors[i], &encoder->sentRowColors[i]);
+		}
+		if (!isChanged) {
+			return 0;
+		}
+	}
+
+	for (uint8_t i = 0; i < FULL_LED_ROWS; ++i) {
+		encoder->sentRowColors[i] = colors[i];
+	}
+	encoder->sentRowColorsValid = 1;
+	encoder->keyframeTimeNanos = getNanos();
+	if (paletteSize) {
+		for (uint8_t i = 0; i < paletteSize; ++i) {
+			encoder->palette[i] = palette[i];
+		}
+		encoder->paletteSize = paletteSize;
+	}
+	return 1;
+}
+
+void initPixelEncoder(struct PixelEncoder* encoder) {
+	encoder->sentPixelsValid = 0;
+}
+
+void invalidatePixelEncoder(struct PixelEncoder* encoder) {
+	encoder->sentPixelsValid = 0;
+}
+
+uint16_t findDirtyPixelTiles(struct PixelEncoder* encoder, struct Framebuffer* framebuffer, uint8_t* dirtyTiles) {
+	uint16_t numDirtyTiles = 0;
+	for (uint16_t i = 0; i < NUM_PIXEL_TILES; ++i) {
+		struct GRBColor* pixels = framebuffer->tiles[i].pixels;
+		if (encoder->sentPixelsValid && memcmp(pixels, encoder->sentPixels[i], sizeof(encoder->sentPixels[i])) == 0) {
+			continue;
+		}
+		memcpy(encoder->sentPixels[i], pixels, sizeof(encoder->sentPixels[i]));
+		dirtyTiles[numDirtyTiles++] = (uint8_t) i;
+	}
+	encoder->sentPixelsValid = 1;
+	return numDirtyTiles;
+}
+
+uint16_t encodePongData(uint8_t* packet, uint8_t paddle1Y, uint8_t paddle2Y, uint8_t ballX, uint8_t ballY) {
+	packet[0] = CMD_BYTE;
+	packet[1] = SET_PONG_DATA_CODE;
+	packet[2] = paddle1Y;
+	packet[3] = paddle2Y;
+	packet[4] = ballX;
+	packet[5] = ballY;
+	return PONG_DATA_PACKET_SIZE;
+}
+
+uint16_t encodePongScore(uint8_t* packet, uint8_t score1, uint8_t score2) {
+	packet[0] = CMD_BYTE;
+	packet[1] = SET_PONG_SCORE_CODE;
+	packet[2] = score1;
+	packet[3] = score2;
+	return PONG_SCORE_PACKET_SIZE;
+}
+
+uint16_t encodeLatchMode(uint8_t* packet, uint8_t isEnabled) {
+	packet[0] = CMD_BYTE;
+	packet[1] = SET_LATCH_MODE_CODE;
+	packet[2] = isEnabled;
+	return SET_LATCH_MODE_PACKET_SIZE;
+}
+
+uint16_t encodeLatchFrame(uint8_t* packet, uint32_t frameNumber) {
+	packet[0] = CMD_BYTE;
+	packet[1] = LATCH_FRAME_CODE;
+	packet[2] = frameNumber & 0xFF;
+	return LATCH_FRAME_PACKET_SIZE;
+}
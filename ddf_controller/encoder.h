@@ -0,0 +1,75 @@
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#include <stdint.h>
+
+#include "effects.h"
+#include "protocol.h"
+
+// Row delta updates
+// Only rows that changed since the last write are sent, as SET_ROW_RANGE_COLOR_CODE packets
+// A full SET_ROWS_COLOR_CODE packet is still sent when it would be smaller, and every ROW_KEYFRAME_INTERVAL_MS even if
+// nothing changed, so bytes lost on a link without framing don't stay on the panel
+// Firmware without range support gets the full packet whenever anything changed
+#define USE_ROW_DELTAS 1
+#define ROW_KEYFRAME_INTERVAL_MS 1000
+
+// Full resolution output, for firmware with the row commands
+// Changed rows are sent as SET_FULL_RES_RANGE_CODE packets, or all FULL_LED_ROWS rows as whichever of the full resolution
+// packets is smallest for the frame when that is smaller
+// Frames where each pair of rows matches are sent as a SET_ROWS_COLOR_CODE packet instead
+// Frames with few colors are sent as palette indices, uploading the palette first only when it changes
+// Older firmware gets every other row at half resolution
+#define USE_FULL_RES_ROWS 1
+
+// Nothing larger than a raw full resolution packet is ever produced, a palette upload and indexed frame included
+#define MAX_ROW_PACKET_SIZE FULL_RES_ROWS_PACKET_SIZE
+
+struct RowEncoder {
+	struct RGBColor sentRowColors[FULL_LED_ROWS];  // Shadow copy of what the FPGA is currently displaying, only the first LED_ROWS are used at half resolution
+	uint8_t sentRowColorsValid;
+	unsigned long long keyframeTimeNanos;  // When the last full frame was encoded
+	struct RGBColor palette[MAX_PALETTE_SIZE];  // Palette the FPGA currently holds
+	uint8_t paletteSize;  // 0 if the FPGA has no known palette
+};
+
+// Per-pixel tile updates
+// Only tiles that changed since the last write are sent, each straight from the framebuffer as it already holds them as packets
+struct PixelEncoder {
+	struct GRBColor sentPixels[NUM_PIXEL_TILES][PIXEL_TILE_WIDTH * PIXEL_TILE_HEIGHT];  // Shadow copy of what the FPGA is currently displaying
+	uint8_t sentPixelsValid;
+};
+
+void initRowEncoder(struct RowEncoder* encoder);
+
+// Force the next encodeRowColors call to produce a full frame (e.g. after reconnecting or leaving pong)
+void invalidateRowEncoder(struct RowEncoder* encoder);
+
+void initPixelEncoder(struct PixelEncoder* encoder);
+
+// Force the next findDirtyPixelTiles call to return every tile
+void invalidatePixelEncoder(struct PixelEncoder* encoder);
+
+// Each encoder fills packet and returns its size in bytes
+uint16_t encodeAllRowColors(uint8_t* packet, struct RGBColor* colors);
+uint16_t encodeRowColors(struct RowEncoder* encoder, uint8_t* packet, struct RGBColor* colors, uint8_t isRangeSupported);  // 0 if nothing changed
+uint16_t encodeFullResRowColors(struct RowEncoder* encoder, uint8_t* packet, struct RGBColor* colors, uint8_t isRangeSupported);  // FULL_LED_ROWS colors, 0 if nothing changed
+uint16_t encodePongData(uint8_t* packet, uint8_t paddle1Y, uint8_t paddle2Y, uint8_t ballX, uint8_t ballY);
+uint16_t encodePongScore(uint8_t* packet, uint8_t score1, uint8_t score2);
+uint16_t encodeLatchMode(uint8_t* packet, uint8_t isEnabled);
+uint16_t encodeLatchFrame(uint8_t* packet, uint32_t frameNumber);
+
+// Fill dirtyTiles (NUM_PIXEL_TILES) with the indices of tiles that changed since the last call, in increasing order,
+// and update the shadow copy as if they were sent
+// Returns the number of dirty tiles, 0 if nothing changed
+uint16_t findDirtyPixelTiles(struct PixelEncoder* encoder, struct Framebuffer* framebuffer, uint8_t* dirtyTiles);
+
+// Full resolution frames encoded ahead of time, without reference to what the FPGA is showing
+// The packet uploads its own palette if it uses one, returned in palette (MAX_PALETTE_SIZE) and paletteSize
+uint16_t encodeFullResKeyframe(uint8_t* packet, struct RGBColor* colors, struct RGBColor* palette, uint8_t* paletteSize);
+
+// Update the shadow copy for a packet from encodeFullResKeyframe
+// Returns 0 if the FPGA already shows colors and no keyframe is due, so the packet need not be written
+uint8_t markFullResKeyframeSent(struct RowEncoder* encoder, struct RGBColor* colors, struct RGBColor* palette, uint8_t paletteSize);
+
+#endif
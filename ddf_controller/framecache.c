@@ -0,0 +1,62 @@
+#include "framecache.h"
+
+void initFrameCache(struct FrameCache* cache) {
+	for (uint16_t i = 0; i < FRAME_CACHE_SIZE; ++i) {
+		cache->entries[i].isValid = 0;
+	}
+	cache->lastKey.animationMode = 0;
+	cache->lastKey.colorMode = 0;
+	cache->lastKey.brightness = 0;
+	cache->hits = 0;
+	cache->misses = 0;
+}
+
+uint8_t isFrameCacheable(enum AnimationMode animationMode) {
+	return animationMode == ANIMATION_OFF || animationMode == ANIMATION_SOLID || animationMode == ANIMATION_RAINBOW || animationMode == ANIMATION_ALTERNATING;
+}
+
+uint8_t frameCacheKeysEqual(struct FrameCacheKey* a, struct FrameCacheKey* b) {
+	return a->animationMode == b->animationMode && a->colorMode == b->colorMode
+		&& a->color.r == b->color.r && a->color.g == b->color.g && a->color.b == b->color.b
+		&& a->brightness == b->brightness && a->gain == b->gain && a->phaseBucket == b->phaseBucket;
+}
+
+// FNV-1a over the fields that vary within one mode and brightness
+uint32_t hashFrameCacheKey(struct FrameCacheKey* key) {
+	uint8_t bytes[9] = {
+		key->color.r, key->color.g, key->color.b, key->gain & 0xFF, key->gain >> 8,
+		key->phaseBucket & 0xFF, (key->phaseBucket >> 8) & 0xFF, (key->phaseBucket >> 16) & 0xFF, key->phaseBucket >> 24
+	};
+	uint32_t hash = 2166136261u;
+	for (uint8_t i = 0; i < 9; ++i) {
+		hash = (hash ^ bytes[i]) * 16777619u;
+	}
+	return hash;
+}
+
+struct FrameCacheEntry* lookupFrame(struct FrameCache* cache, struct FrameCacheKey* key) {
+	if (key->animationMode != cache->lastKey.animationMode || key->colorMode != cache->lastKey.colorMode || key->brightness != cache->lastKey.brightness) {
+		for (uint16_t i = 0; i < FRAME_CACHE_SIZE; ++i) {
+			cache->entries[i].isValid = 0;
+		}
+		cache->lastKey = *key;
+	}
+
+	struct FrameCacheEntry* entry = &cache->entries[hashFrameCacheKey(key) & (FRAME_CACHE_SIZE - 1)];
+	if (entry->isValid && frameCacheKeysEqual(&entry->key, key)) {
+		++cache->hits;
+		return entry;
+	}
+
+	++cache->misses;
+	entry->isValid = 0;
+	entry->key = *key;
+	return entry;
+}
+
+void fillFrameCacheEntry(struct FrameCacheEntry* entry, struct RGBColor* rowColors, uint8_t isSmooth, uint16_t gain) {
+	expandRowColors(rowColors, entry->rowColors, isSmooth);
+	scaleColors(entry->rowColors, FULL_LED_ROWS, gain);
+	entry->packetSize = encodeFullResKeyframe(entry->packet, entry->rowColors, entry->palette, &entry->paletteSize);
+	entry->isValid = 1;
+}
@@ -0,0 +1,59 @@
+#ifndef FRAMECACHE_H
+#define FRAMECACHE_H
+
+#include <stdint.h>
+
+#include "color.h"
+#include "effects.h"
+#include "encoder.h"
+#include "protocol.h"
+
+// Pre-encoded frames for animations whose output only depends on a few values
+// Hits skip both rendering and encoding, the writer thread sends the stored packet as is
+// Off, solid, rainbow and alternating frames are cached, periodic animations are rendered at FRAME_CACHE_PHASE_BITS phases per period
+#define USE_FRAME_CACHE 1
+#define FRAME_CACHE_SIZE 256  // Must be a power of two, entries are direct-mapped
+#define FRAME_CACHE_PHASE_BITS 8
+#define FRAME_CACHE_GAIN_STEP 8  // Q8, cached frames are scaled by gains rounded to this so the audio level doesn't miss every frame
+
+// Phase a periodic animation is rendered at for a bucket
+#define FRAME_CACHE_PHASE(bucket) ((uint32_t) (bucket) << (32 - FRAME_CACHE_PHASE_BITS))
+
+struct FrameCacheKey {
+	uint8_t animationMode;
+	uint8_t colorMode;
+	struct RGBColor color;  // Solid color before the gain
+	uint32_t brightness;  // Q16
+	uint16_t gain;  // Q8 gain the frame is scaled by, follows the audio level in the solid mode
+	uint32_t phaseBucket;
+};
+
+struct FrameCacheEntry {
+	struct FrameCacheKey key;
+	uint8_t isValid;
+	struct RGBColor rowColors[FULL_LED_ROWS];
+	struct RGBColor palette[MAX_PALETTE_SIZE];  // Uploaded by the packet, if paletteSize is not 0
+	uint8_t paletteSize;
+	uint16_t packetSize;
+	uint8_t packet[MAX_ROW_PACKET_SIZE];
+};
+
+// Only used by the render loop
+struct FrameCache {
+	struct FrameCacheEntry entries[FRAME_CACHE_SIZE];
+	struct FrameCacheKey lastKey;  // Entries are dropped when the mode or brightness changes from this
+	uint32_t hits;
+	uint32_t misses;
+};
+
+void initFrameCache(struct FrameCache* cache);
+
+uint8_t isFrameCacheable(enum AnimationMode animationMode);
+
+// Returns the entry for key, which is not valid on a miss until fillFrameCacheEntry
+struct FrameCacheEntry* lookupFrame(struct FrameCache* cache, struct FrameCacheKey* key);
+
+// Expand, scale by gain and encode a rendered frame into a missed entry
+void fillFrameCacheEntry(struct FrameCacheEntry* entry, struct RGBColor* rowColors, uint8_t isSmooth, uint16_t gain);
+
+#endif
@@ -0,0 +1,91 @@
+#include <stdio.h>
+
+#include "histogram.h"
+
+void initHistogram(struct Histogram* histogram, const char* name) {
+	histogram->name = name;
+	resetHistogram(histogram);
+}
+
+void resetHistogram(struct Histogram* histogram) {
+	for (uint16_t i = 0; i < HISTOGRAM_NUM_BUCKETS; ++i) {
+		histogram->counts[i] = 0;
+	}
+	histogram->totalCount = 0;
+	histogram->min = (uint64_t) -1;
+	histogram->max = 0;
+	histogram->sum = 0;
+}
+
+uint16_t getBucketIndex(uint64_t value) {
+	if (value >= (1ULL << HISTOGRAM_MAX_BITS)) {
+		return HISTOGRAM_NUM_BUCKETS - 1;
+	}
+
+	// Shift down until only the top HISTOGRAM_SUB_BUCKET_BITS + 1 bits are left
+	uint16_t magnitude = 0;
+	while (value >= 2 * HISTOGRAM_SUB_BUCKETS) {
+		value >>= 1;
+		++magnitude;
+	}
+	if (magnitude == 0) {
+		return (uint16_t) value;
+	}
+	return (uint16_t) (magnitude * HISTOGRAM_SUB_BUCKETS + value);
+}
+
+uint64_t getBucketHighestValue(uint16_t index) {
+	if (index < 2 * HISTOGRAM_SUB_BUCKETS) {
+		return index;
+	}
+	uint16_t magnitude = index / HISTOGRAM_SUB_BUCKETS - 1;
+	uint64_t subBucket = index % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS;
+	return ((subBucket + 1) << magnitude) - 1;
+}
+
+void recordValue(struct Histogram* histogram, uint64_t value) {
+	++histogram->counts[getBucketIndex(value)];
+	++histogram->totalCount;
+	histogram->sum += value;
+	if (value < histogram->min) {
+		histogram->min = value;
+	}
+	if (value > histogram->max) {
+		histogram->max = value;
+	}
+}
+
+uint64_t getPercentile(struct Histogram* histogram, double percentile) {
+	uint64_t targetCount = (uint64_t) (percentile / 100.0 * histogram->totalCount + 0.5);
+	if (targetCount < 1) {
+		targetCount = 1;
+	}
+
+	uint64_t count = 0;
+	for (uint16_t i = 0; i < HISTOGRAM_NUM_BUCKETS; ++i) {
+		count += histogram->counts[i];
+		if (count >= targetCount) {
+			uint64_t value = getBucketHighestValue(i);
+			return (value > histogram->max) ? histogram->max : value;
+		}
+	}
+	return histogram->max;
+}
+
+void printHistogram(struct Histogram* histogram) {
+	if (!histogram->totalCount) {
+		printf("%s: no samples\n", histogram->name);
+		return;
+	}
+	printf(
+		"%s: count %llu  us: min %.1f, p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f, mean %.1f\n",
+		histogram->name, (unsigned long long) histogram->totalCount,
+		histogram->min / 1000.0,
+		getPercentile(histogram, 50) / 1000.0,
+		getPercentile(histogram, 90) / 1000.0,
+		getPercentile(histogram, 99) / 1000.0,
+		getPercentile(histogram, 99.9) / 1000.0,
+		histogram->max / 1000.0,
+		(double) histogram->sum / histogram->totalCount / 1000.0
+	);
+}
@@ -0,0 +1,33 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+// Log-linear histograms of nanosecond durations, in the style of HdrHistogram
+// Values below HISTOGRAM_SUB_BUCKETS are exact, above that each power of two is split into HISTOGRAM_SUB_BUCKETS buckets
+// so every recorded value is kept to within 1 / HISTOGRAM_SUB_BUCKETS
+#define HISTOGRAM_SUB_BUCKET_BITS 4
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_MAX_BITS 40  // Values up to 2^40 ns (about 18 minutes), anything larger is clamped
+#define HISTOGRAM_NUM_BUCKETS ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+struct Histogram {
+	const char* name;
+	uint64_t counts[HISTOGRAM_NUM_BUCKETS];
+	uint64_t totalCount;
+	uint64_t min;
+	uint64_t max;
+	uint64_t sum;
+};
+
+void initHistogram(struct Histogram* histogram, const char* name);
+void resetHistogram(struct Histogram* histogram);
+void recordValue(struct Histogram* histogram, uint64_t value);
+
+// Highest value equivalent to the one at percentile [0, 100]
+uint64_t getPercentile(struct Histogram* histogram, double percentile);
+
+// One line with count, min, p50, p90, p99, p99.9, max and mean in microseconds
+void printHistogram(struct Histogram* histogram);
+
+#endif
@@ -0,0 +1,85 @@
+#include <stdio.h>
+
+#include "input.h"
+
+void pushInputEvent(struct InputQueue* queue, uint8_t key, uint8_t isPressed, unsigned long long timeNanos) {
+	AtomicInt writeCount = queue->writeCount;
+	if ((uint32_t) (writeCount - atomicLoad(&queue->readCount)) >= INPUT_QUEUE_SIZE) {
+		// Render loop has stalled, drop rather than overwrite events it hasn't seen
+		++queue->eventsDropped;
+		return;
+	}
+
+	struct InputEvent* event = &queue->events[writeCount & (INPUT_QUEUE_SIZE - 1)];
+	event->key = key;
+	event->isPressed = isPressed;
+	event->timeNanos = timeNanos;
+	atomicStore(&queue->writeCount, writeCount + 1);
+
+	if (isPressed) {
+		printf("Pressed: %u\n", key);
+	}
+	else {
+		printf("Released: %u\n", key);
+	}
+}
+
+THREAD_FUNC(inputThread) {
+	struct InputQueue* queue = (struct InputQueue*) param;
+
+	while (atomicLoad(&queue->isRunning)) {
+		waitForKeyboard(INPUT_POLL_MS);
+		pollKeyboard();
+
+		unsigned long long now = getNanos();
+		for (uint8_t i = 1; i < NUM_INPUT_KEYS; ++i) {
+			uint8_t isPressed = isKeyPressed(i);
+			if (isPressed != queue->keyIsDown[i]) {
+				queue->keyIsDown[i] = isPressed;
+				pushInputEvent(queue, i, isPressed, now);
+			}
+		}
+	}
+
+	return 0;
+}
+
+void initInputQueue(struct InputQueue* queue) {
+	queue->writeCount = 0;
+	queue->readCount = 0;
+	queue->isRunning = 0;
+	queue->eventsDropped = 0;
+	for (uint8_t i = 0; i < NUM_INPUT_KEYS; ++i) {
+		queue->keyIsDown[i] = 0;
+	}
+}
+
+void startInputThread(struct InputQueue* queue) {
+	initInputQueue(queue);
+	queue->isRunning = 1;
+	startThread(&queue->thread, inputThread, queue);
+}
+
+void stopInputThread(struct InputQueue* queue) {
+	if (!atomicLoad(&queue->isRunning)) {
+		return;
+	}
+	atomicStore(&queue->isRunning, 0);
+	joinThread(&queue->thread);
+}
+
+uint16_t consumeInputEvents(struct InputQueue* queue, struct InputEvent* events, uint16_t maxEvents) {
+	AtomicInt readCount = queue->readCount;
+	uint32_t numAvailable = (uint32_t) (atomicLoad(&queue->writeCount) - readCount);
+	if (numAvailable > maxEvents) {
+		numAvailable = maxEvents;  // The rest wait for the next frame
+	}
+
+	for (uint32_t i = 0; i < numAvailable; ++i) {
+		events[i] = queue->events[(readCount + i) & (INPUT_QUEUE_SIZE - 1)];
+	}
+
+	// Release store hands the slots back only after they were copied
+	atomicStore(&queue->readCount, readCount + numAvailable);
+	return (uint16_t) numAvailable;
+}
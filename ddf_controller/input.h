@@ -0,0 +1,38 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdint.h>
+
+#include "platform.h"
+
+// Keyboard input on its own thread
+// The input thread turns key state changes into events on a single-producer single-consumer queue,
+// the render loop drains the queue once per frame
+#define INPUT_QUEUE_SIZE 256  // Must be a power of two
+#define INPUT_POLL_MS 2  // Longest wait between keyboard polls, bounds release latency
+#define NUM_INPUT_KEYS 128
+
+struct InputEvent {
+	uint8_t key;  // Windows virtual-key code
+	uint8_t isPressed;  // 0 for a release
+	unsigned long long timeNanos;  // When the input thread saw the change
+};
+
+struct InputQueue {
+	Thread thread;
+	struct InputEvent events[INPUT_QUEUE_SIZE];
+	volatile AtomicInt writeCount;
+	volatile AtomicInt readCount;
+	volatile AtomicInt isRunning;
+	AtomicInt eventsDropped;  // Only written by the input thread
+	uint8_t keyIsDown[NUM_INPUT_KEYS];  // Only used by the input thread
+};
+
+void initInputQueue(struct InputQueue* queue);  // An empty queue with no thread, when there is no keyboard to read
+void startInputThread(struct InputQueue* queue);
+void stopInputThread(struct InputQueue* queue);
+
+// Copy up to maxEvents queued events into events, oldest first, without blocking
+uint16_t consumeInputEvents(struct InputQueue* queue, struct InputEvent* events, uint16_t maxEvents);
+
+#endif
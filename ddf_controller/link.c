@@ -0,0 +1,170 @@
+#include "link.h"
+#include "platform.h"
+
+uint16_t linkCrcTable[256];
+
+void initLinkCrcTable() {
+	for (uint16_t i = 0; i < 256; ++i) {
+		uint16_t crc = (uint16_t) (i << 8);
+		for (uint8_t j = 0; j < 8; ++j) {
+			crc = (crc & 0x8000) ? (uint16_t) ((crc << 1) ^ 0x1021) : (uint16_t) (crc << 1);
+		}
+		linkCrcTable[i] = crc;
+	}
+}
+
+uint16_t getLinkCrc(uint16_t crc, const uint8_t* data, uint32_t size) {
+	for (uint32_t i = 0; i < size; ++i) {
+		crc = (uint16_t) ((crc << 8) ^ linkCrcTable[(crc >> 8) ^ data[i]]);
+	}
+	return crc;
+}
+
+uint8_t openLink(struct Link* link, SerialPort serial, uint32_t baudRate) {
+	link->isFramed = 0;
+	link->baudRate = baudRate;
+	link->bufferSize = 0;
+	link->statusSize = 0;
+	link->numFrameBuffers = 0;
+	link->frameSize = 0;
+
+	uint32_t numErrors = 0;
+	for (uint8_t i = 0; i < LINK_OPEN_ATTEMPTS; ++i) {
+		if (resetLink(link, serial, &numErrors)) {
+			// Nothing has been sent yet, so the first credit limit is the whole buffer
+			link->bufferSize = link->creditLimit;
+			link->isFramed = link->bufferSize >= MIN_LINK_BUFFER_SIZE;
+			return link->isFramed;
+		}
+	}
+	return 0;
+}
+
+uint8_t resetLink(struct Link* link, SerialPort serial, uint32_t* numErrors) {
+	// Statuses still on the way count from before the reset
+	flushSerialInput(serial);
+	link->sequence = 0;
+	link->ackedSequence = 0xFF;
+	link->bytesSent = 0;
+	link->creditLimit = 0;
+	link->errorCount = 0;
+	link->statusSize = 0;
+
+	uint8_t packet[GET_LINK_STATUS_PACKET_SIZE] = { CMD_BYTE, GET_LINK_STATUS_CODE, LINK_VERSION };
+	if (writeSerial(serial, packet, GET_LINK_STATUS_PACKET_SIZE) != GET_LINK_STATUS_PACKET_SIZE) {
+		return 0;
+	}
+	return pollLink(link, serial, 1, numErrors);
+}
+
+// The FPGA answers once the bytes it has not consumed yet are through, give it their wire time and LINK_ACK_TIMEOUT_MS
+void extendLinkAckDeadline(struct Link* link) {
+	uint32_t bytesAhead = link->bytesSent - (link->creditLimit - link->bufferSize);
+	link->ackDeadlineNanos = getNanos() + LINK_ACK_TIMEOUT_MS * 1000000ULL;
+	if (link->baudRate) {
+		link->ackDeadlineNanos += (unsigned long long) bytesAhead * UART_BITS_PER_BYTE * 1000000000ULL / link->baudRate;
+	}
+}
+
+// Returns 1 when byte completes a valid status packet
+uint8_t readLinkStatusByte(struct Link* link, uint8_t byte, uint32_t* numErrors) {
+	if (link->statusSize == 0 && byte != CMD_BYTE) {
+		return 0;
+	}
+	if (link->statusSize == 1 && byte != LINK_STATUS_CODE) {
+		link->statusSize = byte == CMD_BYTE;
+		return 0;
+	}
+	link->status[link->statusSize++] = byte;
+	if (link->statusSize < LINK_STATUS_PACKET_SIZE) {
+		return 0;
+	}
+	link->statusSize = 0;
+
+	const uint8_t* status = link->status;
+	uint16_t crc = getLinkCrc(LINK_CRC_INIT, status + 2, LINK_STATUS_PACKET_SIZE - 2 - LINK_FRAME_TRAILER_SIZE);
+	if (status[2] != LINK_VERSION || status[9] != (crc >> 8) || status[10] != (crc & 0xFF)) {
+		return 0;
+	}
+	link->ackedSequence = status[3];
+	link->creditLimit = ((uint32_t) status[4] << 24) | ((uint32_t) status[5] << 16) | ((uint32_t) status[6] << 8) | status[7];
+	*numErrors += (uint8_t) (status[8] - link->errorCount);
+	link->errorCount = status[8];
+	extendLinkAckDeadline(link);
+	return 1;
+}
+
+uint8_t pollLink(struct Link* link, SerialPort serial, uint8_t shouldWait, uint32_t* numErrors) {
+	uint8_t buffer[4 * LINK_STATUS_PACKET_SIZE];
+	uint8_t hasStatus = 0;
+	// A steady stream of bytes that are not statuses doesn't extend the wait
+	unsigned long long deadline = getNanos() + SERIAL_TIMEOUT_MS * 1000000ULL;
+	while (getNanos() < deadline) {
+		// Once a status arrived only take what is already there
+		int32_t bytesAvailable = (shouldWait && !hasStatus) ? (int32_t) sizeof(buffer) : getSerialBytesAvailable(serial);
+		if (bytesAvailable <= 0) {
+			break;
+		}
+		int32_t bytesRead = readSerial(serial, buffer, (bytesAvailable < (int32_t) sizeof(buffer)) ? (uint32_t) bytesAvailable : sizeof(buffer));
+		if (bytesRead <= 0) {
+			break;
+		}
+		for (int32_t i = 0; i < bytesRead; ++i) {
+			hasStatus |= readLinkStatusByte(link, buffer[i], numErrors);
+		}
+	}
+	return hasStatus;
+}
+
+uint16_t buildLinkFrame(struct Link* link, const struct SerialBuffer* packets, uint16_t count) {
+	uint32_t maxPayloadSize = link->bufferSize / 2 - LINK_FRAME_OVERHEAD;
+	if (maxPayloadSize > MAX_LINK_FRAME_PAYLOAD) {
+		maxPayloadSize = MAX_LINK_FRAME_PAYLOAD;
+	}
+
+	// Always take at least one packet, MIN_LINK_BUFFER_SIZE leaves room for any of them
+	uint32_t payloadSize = 0;
+	uint16_t numPackets = 0;
+	while (numPackets < count && numPackets < MAX_SERIAL_BUFFERS - 2 && (numPackets == 0 || payloadSize + packets[numPackets].size <= maxPayloadSize)) {
+		link->frameBuffers[numPackets + 1] = packets[numPackets];
+		payloadSize += packets[numPackets].size;
+		++numPackets;
+	}
+
+	link->header[0] = CMD_BYTE;
+	link->header[1] = LINK_FRAME_CODE;
+	link->header[2] = LINK_VERSION;
+	uint8_t isAnswered = link->ackedSequence == (uint8_t) (link->sequence - 1);
+	link->header[3] = link->sequence++;
+	link->header[4] = (uint8_t) (payloadSize >> 8);
+	link->header[5] = (uint8_t) (payloadSize & 0xFF);
+	uint16_t crc = getLinkCrc(LINK_CRC_INIT, link->header + 2, LINK_FRAME_HEADER_SIZE - 2);
+	for (uint16_t i = 0; i < numPackets; ++i) {
+		crc = getLinkCrc(crc, packets[i].data, packets[i].size);
+	}
+	link->trailer[0] = (uint8_t) (crc >> 8);
+	link->trailer[1] = (uint8_t) (crc & 0xFF);
+
+	link->frameBuffers[0].data = link->header;
+	link->frameBuffers[0].size = LINK_FRAME_HEADER_SIZE;
+	link->frameBuffers[numPackets + 1].data = link->trailer;
+	link->frameBuffers[numPackets + 1].size = LINK_FRAME_TRAILER_SIZE;
+	link->numFrameBuffers = numPackets + 2;
+	link->frameSize = payloadSize + LINK_FRAME_OVERHEAD;
+	link->bytesSent += link->frameSize;
+	// Frames already waiting for an answer keep the deadline from the FPGA's last status
+	if (isAnswered) {
+		extendLinkAckDeadline(link);
+	}
+	return numPackets;
+}
+
+uint8_t hasLinkCredit(struct Link* link) {
+	return (int32_t) (link->creditLimit - link->bytesSent) >= 0;
+}
+
+uint8_t isLinkAckOverdue(struct Link* link) {
+	// A damaged last frame is still consumed and counted in the FPGA's error count
+	uint8_t isConsumed = link->creditLimit - link->bufferSize == link->bytesSent;
+	return !isConsumed && link->ackedSequence != (uint8_t) (link->sequence - 1) && getNanos() > link->ackDeadlineNanos;
+}
@@ -0,0 +1,69 @@
+#ifndef LINK_H
+#define LINK_H
+
+#include <stdint.h>
+
+#include "protocol.h"
+#include "serial.h"
+
+// Host side of the framed FPGA link
+// Each batch of packets goes out as one or more LINK_FRAME_CODE frames, no bigger than half the FPGA's receive buffer
+// so one frame can arrive while the FPGA consumes the previous one
+// Frames are only sent within the credit limit from the FPGA's last status, so the link never overruns its buffer
+// If no status comes in time the link is reset with GET_LINK_STATUS_CODE, and with no answer to that either the frame is not sent
+// A frame lost whole is only counted by the FPGA once a later frame arrives, so one it never answered resets the link too
+// FPGAs without framing support never answer GET_LINK_STATUS_CODE and get bare packets as before
+#define MIN_LINK_BUFFER_SIZE 1024  // Smallest receive buffer worth framing for, half of it holds any single packet
+#define LINK_OPEN_ATTEMPTS 3
+#define LINK_ACK_TIMEOUT_MS SERIAL_TIMEOUT_MS  // Past the wire time of the bytes ahead of a frame
+
+// Only used by the writer thread that owns the port
+struct Link {
+	uint8_t isFramed;
+	uint8_t sequence;  // Of the next frame
+	uint8_t ackedSequence;  // Last good sequence as of the FPGA's last status
+	uint32_t baudRate;
+	unsigned long long ackDeadlineNanos;  // When the FPGA should have answered again, while frames wait for an answer
+	uint32_t bufferSize;  // FPGA receive buffer, the credit limit right after GET_LINK_STATUS_CODE
+	uint32_t bytesSent;  // Frame bytes since GET_LINK_STATUS_CODE, wraps
+	uint32_t creditLimit;  // bytesSent may not pass this, wraps
+	uint8_t errorCount;  // Frames the FPGA dropped as of its last status, wraps
+
+	uint8_t status[LINK_STATUS_PACKET_SIZE];  // Status packet being read
+	uint8_t statusSize;
+
+	// Last frame built, header, packets and CRC ready for writeSerialBuffers
+	uint8_t header[LINK_FRAME_HEADER_SIZE];
+	uint8_t trailer[LINK_FRAME_TRAILER_SIZE];
+	struct SerialBuffer frameBuffers[MAX_SERIAL_BUFFERS];
+	uint16_t numFrameBuffers;
+	uint32_t frameSize;
+};
+
+void initLinkCrcTable();
+
+// Incremental CRC-16/CCITT-FALSE, start with LINK_CRC_INIT
+uint16_t getLinkCrc(uint16_t crc, const uint8_t* data, uint32_t size);
+
+// Ask the FPGA for its link status and switch to frames if it answers with LINK_VERSION, returns isFramed
+uint8_t openLink(struct Link* link, SerialPort serial, uint32_t baudRate);
+
+// Send GET_LINK_STATUS_CODE and wait up to SERIAL_TIMEOUT_MS for the answer, which restarts the sequence and credit
+// Frames built before the reset must be built again, returns 1 if the FPGA answered
+uint8_t resetLink(struct Link* link, SerialPort serial, uint32_t* numErrors);
+
+// Read status packets that already arrived, or wait for one if shouldWait, never longer than SERIAL_TIMEOUT_MS
+// Adds frames the FPGA dropped since the previous status to numErrors, returns 1 if any status was read
+uint8_t pollLink(struct Link* link, SerialPort serial, uint8_t shouldWait, uint32_t* numErrors);
+
+// Frame as many of the packets as fit and take the frame's sequence number and credit
+// Fills frameBuffers, returns the number of packets framed
+uint16_t buildLinkFrame(struct Link* link, const struct SerialBuffer* packets, uint16_t count);
+
+// The last frame built fits the credit limit
+uint8_t hasLinkCredit(struct Link* link);
+
+// The FPGA has not answered the last frame built in time, so frames since its last good sequence were lost
+uint8_t isLinkAckOverdue(struct Link* link);
+
+#endif
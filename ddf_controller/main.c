@@ -1,107 +1,188 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <inttypes.h>
-#include <sys/timeb.h>
 
-#include <windows.h>
+#include "beat.h"
+#include "color.h"
+#include "effects.h"
+#include "encoder.h"
+#include "framecache.h"
+#include "histogram.h"
+#include "input.h"
+#include "link.h"
+#include "metrics.h"
+#include "oscillator.h"
+#include "pcm.h"
+#include "platform.h"
+#include "predict.h"
+#include "probe.h"
+#include "protocol.h"
+#include "recorder.h"
+#include "renderpool.h"
+#include "serial.h"
+#include "txqueue.h"
 
-#define PI 3.14159265
-
-// LED_ROWS is actually half the real number of rows for performance purposes
-#define LED_ROWS 36
-#define FULL_LED_ROWS 72
-#define LED_COLS 165
-
-#define NUM_KEYS 128
-#define CMD_BYTE 255
-
-// Serial command codes
-#define SET_ROWS_COLOR_CODE 22
-#define SET_PONG_DATA_CODE 23
-#define SET_PONG_SCORE_CODE 24
 
 #define RAINBOW_PERIOD_MS 800
+#define ALTERNATING_PERIOD_MS 600
+
+#define PLASMA_BRIGHTNESS 0.2  // Color gain at full brightness, the solid colors peak at about 50 of 255
 
 #define COLOR_CHANGE_THRESHOLD 0.1
 #define MIN_AUDIO_LEVEL 0
 
-// focus = WAVE_SPEED * t
-#define WAVE_SPEED 0.1
-
-#define WAVE_SIZE 16
-#define MAX_NUM_WAVES 4
-
-#define SIN_LUT_SAMPLES 4096
-
-// Pong
-#define PADDLE_WIDTH 5
-#define PADDLE_HEIGHT 16
-#define PADDLE_SPEED 0.00006
-#define BALL_WIDTH 6
-#define BALL_HEIGHT 3
-#define BALL_SPEED 0.000075
-#define MAX_BALL_ANGLE 0.9
-
-enum ColorMode {
-	RAINBOW,
-	RED,
-	ORANGE,
-	YELLOW,
-	GREEN,
-	BLUE,
-	PURPLE,
-	WHITE,
-	RED_BLUE,
-	GREEN_BLUE
-};
+// Arduino audio input
+#define AUDIO_RING_SIZE 1024  // Must be a power of two
+#define AUDIO_READ_CHUNK_SIZE 256
+#define AUDIO_MAX_SAMPLES_PER_FRAME 16  // Older samples have no visible effect on the smoothed level
 
-enum AnimationMode {
-	ANIMATION_OFF,
-	ANIMATION_SOLID,
-	ANIMATION_WAVE,
-	ANIMATION_RAINBOW,
-	ANIMATION_ALTERNATING,
-	ANIMATION_PONG
-};
+#define INPUT_MAX_EVENTS_PER_FRAME 32
+
+#define LATENCY_SMOOTHING_FRAMES 8  // Latency estimates move 1/8 of the way to each new measurement
 
-enum WaveDirection {
-	WAVE_DIR_UP,
-	WAVE_DIR_DOWN
+#define RECORD_FLUSH_PERIOD_MS 1000  // Bounds how much of the record log a crash can lose
+
+enum FrameType {
+	FRAME_ROWS,
+	FRAME_ENCODED,  // Rows already encoded by the frame cache
+	FRAME_PIXELS,
+	FRAME_PONG
 };
 
-struct RGBColor {
-	uint8_t r;  // [0, 255]
-	uint8_t g;  // [0, 255]
-	uint8_t b;  // [0, 255]
+struct Frame {
+	enum FrameType type;
+	struct RGBColor rowColors[FULL_LED_ROWS];  // Only the first LED_ROWS are used at half resolution
+	struct Framebuffer framebuffer;  // FRAME_PIXELS only
+	uint8_t pongData[4];  // Paddle 1 y, paddle 2 y, ball x, ball y
+	unsigned long long audioTimeNanos;  // Newest audio sample the frame was rendered from, 0 for none
+	unsigned long long publishTimeNanos;
+
+	// FRAME_ENCODED only, rowColors holds all FULL_LED_ROWS
+	struct RGBColor palette[MAX_PALETTE_SIZE];
+	uint8_t paletteSize;
+	uint16_t packetSize;
+	uint8_t packet[MAX_ROW_PACKET_SIZE];
 };
-struct HSVColor {
-	double h;  // [0, 360]
-	double s;  // [0, 1]
-	double v;  // [0, 1]
+
+struct FrameMailbox;
+
+// One FPGA port and the writer thread that owns it
+struct FpgaOutput {
+	struct FrameMailbox* mailbox;
+	uint8_t index;
+	Thread thread;
+	const char* port;
+	uint32_t configuredBaudRate;  // 0 to probe for the fastest rate
+	SerialPort fpgaSerial;  // Only used by the writer thread once started
+	struct Recorder* recorder;  // NULL for all but the first output, the record log holds a single FPGA stream
+	char name[16];
+
+	// Only used by the writer thread
+	struct RowEncoder rowEncoder;
+	struct PixelEncoder pixelEncoder;
+	uint8_t dirtyTiles[NUM_PIXEL_TILES];
+	struct TransmitQueue transmitQueue;  // Packets for the current tick, flushed in one write
+	uint8_t isLinkBackedUp;  // The last write timed out, droppable packets are skipped until one completes
+	struct Link link;
+	uint8_t hasRowCommands;  // The FPGA answered the probe or the link status, so it takes the row commands from 25 to 31
+	uint8_t isResyncRequested;  // The FPGA missed packets, so its state is resent in full
+
+	uint32_t frameNumber;  // Front frame this output last wrote, protected by the mailbox lock
+
+	// Protected by the mailbox lock
+	uint8_t pongScoreIsPending;
+	uint8_t reconnectIsRequested;
+	uint8_t histogramDumpIsRequested;
+
+	// Only used by the writer thread
+	// Frames count as on the wire once their last byte would have gone out at the link's baud rate
+	struct Histogram writeTimes;
+	struct Histogram barrierTimes;  // Waiting for the other outputs to finish the same frame
+	struct Histogram outputTimes;  // Publish to on the wire
+	struct Histogram pipelineTimes;  // Audio sample read to on the wire
+
+	volatile AtomicInt framesWritten;
+	volatile AtomicInt pixelTilesWritten;
+	volatile AtomicInt bytesWritten;
+	volatile AtomicInt writeTimeouts;
+	volatile AtomicInt writeErrors;
+	volatile AtomicInt serialWrites;
+	volatile AtomicInt packetsDropped;  // Droppable packets replaced in the queue or skipped
+	volatile AtomicInt isFramed;  // The FPGA answered with a framed link
+	volatile AtomicInt linkErrors;  // Frames the FPGA dropped for a bad CRC or a sequence gap or never answered, and ticks dropped with the link down
+	volatile AtomicInt creditStalls;  // Frames that waited for the FPGA to free buffer space
+	volatile AtomicInt baudRate;  // Rate the link is running at
+	volatile AtomicInt outputLatencyMicros;  // Smoothed publish to on the wire
+	volatile AtomicInt pipelineLatencyMicros;  // Smoothed audio sample read to on the wire
 };
 
-struct WaveData {
-	int16_t focus;
-	long animationStartingTime;
-	enum WaveDirection direction;
-	uint8_t animationIsFinished;
+// Triple-buffered handoff between the render loop and the serial writer threads
+// The render loop owns frames[backIndex], the writer threads share frames[frontIndex] read-only
+// Publishing a frame before the writers pick up the previous one drops the previous one
+// Every output writes every front frame, and the next frame only moves to the front once all of them are done with it
+// With more than one output the panels run in latch mode and each frame is latched after all outputs have written it,
+// so all panels show the same frame number
+struct FrameMailbox {
+	Mutex lock;
+	Condition frameReady;  // Broadcast for new frames, requests, and frame barrier completion
+
+	struct Frame frames[3];
+	uint8_t backIndex;
+	uint8_t readyIndex;
+	uint8_t frontIndex;
+	uint8_t hasNewFrame;
+	unsigned long long audioTimeNanos;  // Only used by the render loop, tags each published frame
+
+	uint32_t frontFrameNumber;  // Counts frames moved to the front
+	uint32_t completedFrameNumber;  // Last front frame every output has finished writing
+	uint8_t numOutputsWriting;  // Outputs still writing the front frame
+	uint8_t frontFrameIsWritten;  // Some output wrote bytes for the front frame
+	uint8_t completedFrameIsWritten;  // Some output wrote bytes for the completed frame, so it needs a latch
+
+	uint8_t pongScore[2];
+	uint8_t isRunning;
+
+	uint8_t numOutputs;
+	struct FpgaOutput outputs[MAX_FPGA_OUTPUTS];
+
+	AtomicInt framesPublished;
+	AtomicInt framesDropped;
 };
 
-struct Paddle {
-	uint8_t score;
-	double y;
-	struct RGBColor color;
+struct AudioSample {
+	uint8_t level;
+	uint8_t isBeat;  // PCM input only
+	uint8_t bandLevels[NUM_AUDIO_BANDS];  // PCM input only
+	unsigned long long timeNanos;  // When the byte was read from the Arduino port, or the PCM hop was read
 };
 
-struct Ball {
-	double x, y;
-	double vx, vy;
-	struct RGBColor color;
+// Single-producer single-consumer ring filled by the Arduino reader thread
+// The reader thread only advances writeCount and the render loop only advances readCount, so no lock is needed
+// If the render loop falls more than AUDIO_RING_SIZE samples behind, the oldest samples are overwritten and discarded
+// With a "pcm:" port the ring is filled by the PCM analysis thread instead, one sample per hop
+struct AudioRing {
+	Thread thread;
+	const char* port;
+	const char* pcmPath;  // NULL for the Arduino
+	uint32_t baudRate;
+	SerialPort arduinoSerial;  // Only used by the reader thread once started
+	struct Recorder* recorder;
+
+	struct AudioSample samples[AUDIO_RING_SIZE];
+	volatile AtomicInt writeCount;
+	AtomicInt readCount;
+
+	volatile AtomicInt reconnectIsRequested;
+	volatile AtomicInt isRunning;
+
+	AtomicInt samplesConsumed;
+	AtomicInt samplesDiscarded;
 };
 
 struct RGBColor rowColors[LED_ROWS];
-double sinLut[SIN_LUT_SAMPLES];
 
 const struct RGBColor red = { 50, 0, 0 };
 const struct RGBColor orange = { 49, 5, 0 };
@@ -113,258 +194,919 @@ const struct RGBColor white = { 16, 16, 16 };
 
 unsigned long long pongStart = 0;
 unsigned long long pongEnd = 0;
+unsigned long long pongLag = 0;  // Nanoseconds not simulated yet, less than PONG_TICK_US after each frame
+
+// Read the FPGA's link status, returns 0 if shouldWait and none arrived
+// Dropped frames lost packets the encoders assumed were shown, so the next tick resends everything
+uint8_t pollFpgaLink(struct FpgaOutput* output, uint8_t shouldWait) {
+	uint32_t numErrors = 0;
+	uint8_t hasStatus = pollLink(&output->link, output->fpgaSerial, shouldWait, &numErrors);
+	if (numErrors) {
+		atomicAdd(&output->linkErrors, numErrors);
+		output->isResyncRequested = 1;
+	}
+	return hasStatus;
+}
 
-struct RGBColor hsvToRgb(struct HSVColor* color) {
-	double c = color->v * color->s;
-	double hPrime = color->h / 60.0f;
-	double x = c * (1 - fabs(fmod(hPrime, 2.0) - 1));
-	double r1, g1, b1;
-	if (hPrime >= 5) {
-		r1 = c;
-		g1 = 0;
-		b1 = x;
-	}
-	else if (hPrime >= 4) {
-		r1 = x;
-		g1 = 0;
-		b1 = c;
-	}
-	else if (hPrime >= 3) {
-		r1 = 0;
-		g1 = x;
-		b1 = c;
-	}
-	else if (hPrime >= 2) {
-		r1 = 0;
-		g1 = c;
-		b1 = x;
-	}
-	else if (hPrime >= 1) {
-		r1 = x;
-		g1 = c;
-		b1 = 0;
+// Write buffers in one call and count the result
+// The encoders' shadow copies already count the packets as shown, so a failed or short write resyncs the FPGA
+void writeFpgaSerial(struct FpgaOutput* output, const struct SerialBuffer* buffers, uint16_t count, uint32_t size) {
+	int32_t bytesWritten = writeSerialBuffers(output->fpgaSerial, buffers, count);
+	atomicIncrement(&output->serialWrites);
+	output->isLinkBackedUp = bytesWritten < 0 || (uint32_t) bytesWritten < size;
+	if (output->isLinkBackedUp) {
+		output->isResyncRequested = 1;
 	}
-	else {
-		r1 = c;
-		g1 = x;
-		b1 = 0;
+	if (bytesWritten < 0) {
+		atomicIncrement(&output->writeErrors);
+		return;
+	}
+	if ((uint32_t) bytesWritten < size) {
+		atomicIncrement(&output->writeTimeouts);
 	}
-	double m = color->v * color->s;
-	struct RGBColor result;
-	result.r = (uint8_t) ((r1 + m) * 255);
-	result.g = (uint8_t) ((g1 + m) * 255);
-	result.b = (uint8_t) ((b1 + m) * 255);
-	return result;
+	atomicAdd(&output->bytesWritten, bytesWritten);
 }
 
-unsigned long long getMicros() {
-	FILETIME ft;
-	GetSystemTimeAsFileTime(&ft);
-	unsigned long long tt = ft.dwHighDateTime;
-	tt <<= 32;
-	tt |= ft.dwLowDateTime;
-	tt /= 10;
-	return tt;
+// Ask for a fresh link status, which restarts the credit and the sequence
+// Frames the FPGA dropped before the reset go uncounted, so it gets resynced either way
+// Returns 0 if the link is down, the caller then drops the rest of the tick instead of overrunning the FPGA's buffer
+uint8_t resetFpgaLink(struct FpgaOutput* output) {
+	output->isResyncRequested = 1;
+	uint32_t numErrors = 0;
+	if (!resetLink(&output->link, output->fpgaSerial, &numErrors)) {
+		atomicIncrement(&output->linkErrors);
+		output->isLinkBackedUp = 1;
+		return 0;
+	}
+	return 1;
 }
 
-void initSinLut() {
-	// Precompute sin for better performance
-	for (uint16_t i = 0; i < SIN_LUT_SAMPLES; ++i) {
-		sinLut[i] = sin((double) i / SIN_LUT_SAMPLES * 2 * PI);
+// Write several packets to the FPGA and count the result
+// Framed links send them in as few frames as the FPGA's receive buffer allows, each once the FPGA has room for it
+// The record log holds the bare packets either way, so replays work with and without framing
+void writeFpgaBuffers(struct FpgaOutput* output, struct SerialBuffer* buffers, uint16_t count) {
+	unsigned long long now = getNanos();
+	uint32_t size = 0;
+	for (uint16_t i = 0; i < count; ++i) {
+		recordData(output->recorder, RECORD_FPGA_PACKET, now, buffers[i].data, (uint16_t) buffers[i].size);
+		size += buffers[i].size;
+	}
+	struct Link* link = &output->link;
+	if (!link->isFramed) {
+		writeFpgaSerial(output, buffers, count, size);
+		return;
 	}
-}
 
-double getSinLut(double theta) {
-	while (theta >= 2 * PI) {
-		theta -= 2 * PI;
+	pollFpgaLink(output, 0);
+	// Frames the FPGA never answered were lost whole
+	if (isLinkAckOverdue(link)) {
+		atomicIncrement(&output->linkErrors);
+		if (!resetFpgaLink(output)) {
+			return;
+		}
 	}
-	while (theta < 0) {
-		theta += 2 * PI;
+	uint16_t numFramed = 0;
+	while (numFramed < count) {
+		uint16_t numPackets = buildLinkFrame(link, buffers + numFramed, count - numFramed);
+		if (!hasLinkCredit(link)) {
+			atomicIncrement(&output->creditStalls);
+			while (!hasLinkCredit(link) && pollFpgaLink(output, 1)) {
+			}
+		}
+		// No status came in time, so number the frame again from a reset
+		if (!hasLinkCredit(link)) {
+			if (!resetFpgaLink(output)) {
+				return;
+			}
+			numPackets = buildLinkFrame(link, buffers + numFramed, count - numFramed);
+		}
+		writeFpgaSerial(output, link->frameBuffers, link->numFrameBuffers, link->frameSize);
+		numFramed += numPackets;
 	}
-	return sinLut[(uint16_t) (theta / (2 * PI) * SIN_LUT_SAMPLES)];
 }
 
-double getCosLut(double theta) {
-	return getSinLut(theta + PI / 2.0);
+// Send everything queued for this tick in one write
+void flushFpga(struct FpgaOutput* output) {
+	struct TransmitQueue* queue = &output->transmitQueue;
+	if (queue->numBuffers) {
+		writeFpgaBuffers(output, queue->buffers, queue->numBuffers);
+		clearTransmitQueue(queue);
+	}
 }
 
-void resetPong(struct Paddle *paddle1, struct Paddle *paddle2, struct Ball *ball, uint8_t serverIs1) {
-	paddle1->y = FULL_LED_ROWS / 2.0 - PADDLE_HEIGHT / 2.0;
-	paddle2->y = FULL_LED_ROWS / 2.0 - PADDLE_HEIGHT / 2.0;
-	ball->x = LED_COLS / 2.0 - BALL_WIDTH / 2.0;
-	ball->y = FULL_LED_ROWS / 2.0 - BALL_WIDTH / 2.0;
-	
-	if (serverIs1) {
-		ball->vx = -BALL_SPEED;
+// Queue a packet for the next flush, referenced packets must stay valid until then
+// Reliable packets are always sent, flushing early if the queue is full
+void queueFpga(struct FpgaOutput* output, enum TransmitPriority priority, const uint8_t* packet, uint32_t packetSize, uint8_t isReference) {
+	if (priority == TRANSMIT_DROPPABLE && output->isLinkBackedUp) {
+		atomicIncrement(&output->packetsDropped);
+		return;
+	}
+	struct TransmitQueue* queue = &output->transmitQueue;
+	enum QueueResult result = isReference
+		? queuePacketReference(queue, priority, packet, packetSize)
+		: queuePacket(queue, priority, packet, (uint16_t) packetSize);
+	if (result == QUEUE_REPLACED) {
+		atomicIncrement(&output->packetsDropped);
+	}
+	else if (result == QUEUE_FULL) {
+		if (priority == TRANSMIT_DROPPABLE) {
+			atomicIncrement(&output->packetsDropped);
+			return;
+		}
+		flushFpga(output);
+		if (isReference) {
+			queuePacketReference(queue, priority, packet, packetSize);
+		}
+		else {
+			queuePacket(queue, priority, packet, (uint16_t) packetSize);
+		}
+	}
+}
+
+// Write colors to FPGA, sending only rows that changed since the last write
+// Firmware without the row commands gets every other row of a full resolution frame
+void setRowColors(struct FpgaOutput* output, struct RowEncoder* encoder, struct RGBColor* colors) {
+	uint8_t packet[MAX_ROW_PACKET_SIZE];
+	uint16_t packetSize;
+	if (USE_FULL_RES_ROWS && output->hasRowCommands) {
+		packetSize = encodeFullResRowColors(encoder, packet, colors, output->link.isFramed);
+	}
+	else if (USE_FULL_RES_ROWS) {
+		struct RGBColor halfResColors[LED_ROWS];
+		for (uint8_t i = 0; i < LED_ROWS; ++i) {
+			halfResColors[i] = colors[2 * i];
+		}
+		packetSize = encodeRowColors(encoder, packet, halfResColors, 0);
 	}
 	else {
-		ball->vx = BALL_SPEED;
+		packetSize = encodeRowColors(encoder, packet, colors, output->hasRowCommands);
 	}
-	
-	ball->vy = 0;
+	if (packetSize) {
+		queueFpga(output, TRANSMIT_RELIABLE, packet, packetSize, 0);
+	}
+}
 
-	pongStart = getMicros();
-	pongEnd = pongStart;
+// Fill global rowColors array with color
+void setColor(struct RGBColor* color) {
+	for (uint8_t i = 0; i < LED_ROWS; ++i) {
+		rowColors[i].r = color->r;
+		rowColors[i].g = color->g;
+		rowColors[i].b = color->b;
+	}
 }
 
-void resetPongAndScore(struct Paddle* paddle1, struct Paddle* paddle2, struct Ball* ball) {
-	resetPong(paddle1, paddle2, ball, 1);
-	paddle1->score = 0;
-	paddle2->score = 0;
+// Send updated pong game state to FPGA (when a position changes)
+// Positions are droppable, the next one replaces them
+void setPongData(struct FpgaOutput* output, uint8_t paddle1Y, uint8_t paddle2Y, uint8_t ballX, uint8_t ballY) {
+	uint8_t packet[PONG_DATA_PACKET_SIZE];
+	queueFpga(output, TRANSMIT_DROPPABLE, packet, encodePongData(packet, paddle1Y, paddle2Y, ballX, ballY), 0);
 }
 
-// Write contents of global rowColors array to FPGA
-void setRowColors(HANDLE hSerial) {
-	uint8_t packet[3 * LED_ROWS + 2];
+// Send updated pong score to FPGA (when point is scored)
+void setPongScore(struct FpgaOutput* output, uint8_t score1, uint8_t score2) {
+	uint8_t packet[PONG_SCORE_PACKET_SIZE];
+	queueFpga(output, TRANSMIT_RELIABLE, packet, encodePongScore(packet, score1, score2), 0);
+}
 
-	packet[0] = CMD_BYTE;
-	packet[1] = SET_ROWS_COLOR_CODE;
-	for (uint8_t i = 0; i < LED_ROWS; ++i) {
-		packet[3 * i + 2] = rowColors[i].g;
-		packet[3 * i + 3] = rowColors[i].r;
-		packet[3 * i + 4] = rowColors[i].b;
+// Fill global rowColors array with zeros
+void setOff() {
+	struct RGBColor color = { 0, 0, 0 };
+	setColor(&color);
+}
+
+// A single panel shows frames as they arrive
+void queueLatchMode(struct FpgaOutput* output) {
+	if (output->mailbox->numOutputs > 1) {
+		uint8_t packet[SET_LATCH_MODE_PACKET_SIZE];
+		queueFpga(output, TRANSMIT_RELIABLE, packet, encodeLatchMode(packet, 1), 0);
+	}
+}
+
+// Connect at the configured baud rate, or probe for the fastest one the FPGA link handles
+void connectFpga(struct FpgaOutput* output) {
+	uint8_t isProbeAnswered = 0;
+	if (output->configuredBaudRate) {
+		output->fpgaSerial = connectSerial(output->port, output->configuredBaudRate);
+		atomicStore(&output->baudRate, output->configuredBaudRate);
+	}
+	else {
+		// After a reconnect the FPGA is still at the last probed rate unless it was reset
+		uint32_t lastBaudRate = (uint32_t) atomicLoad(&output->baudRate);
+		output->fpgaSerial = connectSerial(output->port, SERIAL_BAUD_RATE);
+		atomicStore(&output->baudRate, probeBaudRate(output->fpgaSerial, lastBaudRate ? lastBaudRate : SERIAL_BAUD_RATE, &isProbeAnswered));
 	}
 
-	DWORD bytesWritten;
-	WriteFile(hSerial, packet, 3 * LED_ROWS + 2, &bytesWritten, NULL);
+	uint32_t baudRate = (uint32_t) atomicLoad(&output->baudRate);
+	uint8_t baudRateBytes[4] = { baudRate & 0xFF, (baudRate >> 8) & 0xFF, (baudRate >> 16) & 0xFF, baudRate >> 24 };
+	recordData(output->recorder, RECORD_FPGA_BAUD_RATE, getNanos(), baudRateBytes, 4);
+
+	output->isResyncRequested = 0;
+	atomicStore(&output->isFramed, openLink(&output->link, output->fpgaSerial, baudRate));
+	if (output->link.isFramed) {
+		printf("%s: Framed link with a %u byte receive buffer\n", output->name, output->link.bufferSize);
+	}
+	else {
+		printf("%s: No framed link support, sending bare packets\n", output->name);
+	}
+	output->hasRowCommands = isProbeAnswered || output->link.isFramed;
+	if (!output->hasRowCommands) {
+		printf("%s: No row command support, sending half resolution rows\n", output->name);
+	}
+
+	queueLatchMode(output);
+	flushFpga(output);
 }
 
-// Fill global rowColors array with color and write to FPGA
-void setColor(HANDLE hSerial, struct RGBColor* color) {
-	for (uint8_t i = 0; i < LED_ROWS; ++i) {
-		rowColors[i].r = color->r;
-		rowColors[i].g = color->g;
-		rowColors[i].b = color->b;
+// Smoothed latency for the render loop and metrics, only written by the writer thread
+void updateLatency(volatile AtomicInt* latencyMicros, unsigned long long latencyNanos) {
+	AtomicInt latency = *latencyMicros;
+	atomicStore(latencyMicros, latency + ((AtomicInt) (latencyNanos / 1000) - latency) / LATENCY_SMOOTHING_FRAMES);
+}
+
+// Wait until every output has written the front frame
+// Returns 1 if the panels need a latch to show it, 0 if no output wrote anything for it or the writers are stopping
+uint8_t waitForFrameBarrier(struct FpgaOutput* output, uint8_t isWritten) {
+	struct FrameMailbox* mailbox = output->mailbox;
+	lockMutex(&mailbox->lock);
+	mailbox->frontFrameIsWritten |= isWritten;
+	if (--mailbox->numOutputsWriting == 0) {
+		mailbox->completedFrameNumber = mailbox->frontFrameNumber;
+		mailbox->completedFrameIsWritten = mailbox->frontFrameIsWritten;
+		broadcastCondition(&mailbox->frameReady);
+	}
+	while (mailbox->isRunning && mailbox->completedFrameNumber != output->frameNumber) {
+		waitCondition(&mailbox->frameReady, &mailbox->lock);
 	}
-	setRowColors(hSerial);
+	// The next front frame cannot complete without this output, so the flag still belongs to this frame
+	uint8_t shouldLatch = mailbox->isRunning && mailbox->completedFrameIsWritten;
+	unlockMutex(&mailbox->lock);
+	return shouldLatch;
 }
 
-// Send updated pong game state to FPGA (every frame)
-void setPongData(HANDLE hSerial, struct Paddle *paddle1, struct Paddle *paddle2, struct Ball *ball) {
-	uint8_t packet[6];
-	packet[0] = CMD_BYTE;
-	packet[1] = SET_PONG_DATA_CODE;
-	packet[2] = (uint8_t) paddle1->y;
-	packet[3] = (uint8_t) paddle2->y;
-	packet[4] = (uint8_t) ball->x;
-	packet[5] = (uint8_t) ball->y;
+THREAD_FUNC(serialWriterThread) {
+	struct FpgaOutput* output = (struct FpgaOutput*) param;
+	struct FrameMailbox* mailbox = output->mailbox;
+	enum FrameType lastFrameType = FRAME_ROWS;
+
+	while (1) {
+		lockMutex(&mailbox->lock);
+		while (
+			mailbox->isRunning && output->frameNumber == mailbox->frontFrameNumber
+			&& !(mailbox->hasNewFrame && mailbox->completedFrameNumber == mailbox->frontFrameNumber)
+			&& !output->pongScoreIsPending && !output->reconnectIsRequested && !output->histogramDumpIsRequested
+		) {
+			waitCondition(&mailbox->frameReady, &mailbox->lock);
+		}
+		if (!mailbox->isRunning) {
+			unlockMutex(&mailbox->lock);
+			break;
+		}
+
+		uint8_t shouldReconnect = output->reconnectIsRequested;
+		output->reconnectIsRequested = 0;
+
+		uint8_t shouldDumpHistogram = output->histogramDumpIsRequested;
+		output->histogramDumpIsRequested = 0;
+
+		// Whichever writer gets here first moves the next frame to the front, once every output is done with the current one
+		if (mailbox->hasNewFrame && mailbox->completedFrameNumber == mailbox->frontFrameNumber) {
+			uint8_t readyIndex = mailbox->readyIndex;
+			mailbox->readyIndex = mailbox->frontIndex;
+			mailbox->frontIndex = readyIndex;
+			mailbox->hasNewFrame = 0;
+			++mailbox->frontFrameNumber;
+			mailbox->numOutputsWriting = mailbox->numOutputs;
+			mailbox->frontFrameIsWritten = 0;
+			broadcastCondition(&mailbox->frameReady);
+		}
+		uint8_t shouldSendFrame = output->frameNumber != mailbox->frontFrameNumber;
+		output->frameNumber = mailbox->frontFrameNumber;
+
+		// A resync only resends the score if the FPGA is drawing pong
+		enum FrameType frameType = shouldSendFrame ? mailbox->frames[mailbox->frontIndex].type : lastFrameType;
+		uint8_t shouldSendScore = output->pongScoreIsPending || (output->isResyncRequested && frameType == FRAME_PONG);
+		uint8_t score1 = mailbox->pongScore[0];
+		uint8_t score2 = mailbox->pongScore[1];
+		output->pongScoreIsPending = 0;
+		unlockMutex(&mailbox->lock);
+
+		// The front buffer is only read by the writer threads from here on
+		if (shouldReconnect) {
+			closeSerial(output->fpgaSerial);
+			output->isLinkBackedUp = 0;
+			connectFpga(output);
+			invalidateRowEncoder(&output->rowEncoder);
+			invalidatePixelEncoder(&output->pixelEncoder);
+		}
+		// The FPGA missed packets, so resend its mode, the score in pong and a full frame
+		if (output->isResyncRequested) {
+			output->isResyncRequested = 0;
+			invalidateRowEncoder(&output->rowEncoder);
+			invalidatePixelEncoder(&output->pixelEncoder);
+			queueLatchMode(output);
+		}
+		if (shouldDumpHistogram) {
+			printf("%s\n", output->name);
+			printHistogram(&output->writeTimes);
+			printHistogram(&output->barrierTimes);
+			printHistogram(&output->outputTimes);
+			printHistogram(&output->pipelineTimes);
+			resetHistogram(&output->writeTimes);
+			resetHistogram(&output->barrierTimes);
+			resetHistogram(&output->outputTimes);
+			resetHistogram(&output->pipelineTimes);
+		}
+		// Everything for this tick is queued and goes out in one write, the score with the frame after it
+		if (shouldSendScore) {
+			setPongScore(output, score1, score2);
+		}
+		if (shouldSendFrame) {
+			unsigned long long writeStartTime = getNanos();
+			AtomicInt bytesWrittenBefore = output->bytesWritten;
+			struct Frame* frame = &mailbox->frames[mailbox->frontIndex];
+			// Once every output is through the barrier the frame can go back to the render loop, so keep what is needed after it
+			unsigned long long publishTimeNanos = frame->publishTimeNanos;
+			unsigned long long audioTimeNanos = frame->audioTimeNanos;
+			// Row, pixel and pong frames each draw over whatever the others left on the panel
+			if (frameType != lastFrameType && (frameType == FRAME_PIXELS || lastFrameType == FRAME_PIXELS || lastFrameType == FRAME_PONG)) {
+				invalidateRowEncoder(&output->rowEncoder);
+				invalidatePixelEncoder(&output->pixelEncoder);
+			}
+			// Renderers draw a single panel, so every output's slice is the whole frame
+			switch (frameType) {
+			case FRAME_ROWS:
+				setRowColors(output, &output->rowEncoder, frame->rowColors);
+				break;
+			case FRAME_ENCODED:
+				// Cached packets use the row commands, so older firmware gets the frame's rows encoded here
+				if (!output->hasRowCommands) {
+					setRowColors(output, &output->rowEncoder, frame->rowColors);
+				}
+				else if (markFullResKeyframeSent(&output->rowEncoder, frame->rowColors, frame->palette, frame->paletteSize)) {
+					queueFpga(output, TRANSMIT_RELIABLE, frame->packet, frame->packetSize, 1);
+				}
+				break;
+			case FRAME_PIXELS: {
+				// Tiles are already packets, so dirty ones go out straight from the framebuffer in the tick's gather write
+				uint16_t numDirtyTiles = findDirtyPixelTiles(&output->pixelEncoder, &frame->framebuffer, output->dirtyTiles);
+				for (uint16_t i = 0; i < numDirtyTiles; ++i) {
+					queueFpga(output, TRANSMIT_RELIABLE, (const uint8_t*) &frame->framebuffer.tiles[output->dirtyTiles[i]], PIXEL_TILE_PACKET_SIZE, 1);
+				}
+				atomicAdd(&output->pixelTilesWritten, numDirtyTiles);
+				break;
+			}
+			case FRAME_PONG:
+				setPongData(output, frame->pongData[0], frame->pongData[1], frame->pongData[2], frame->pongData[3]);
+				break;
+			}
+			lastFrameType = frameType;
+			flushFpga(output);
+			unsigned long long writeEndTime = getNanos();
+			recordValue(&output->writeTimes, writeEndTime - writeStartTime);
+
+			// A single panel passes straight through, and pong is drawn by the FPGA so it is never latched
+			uint8_t shouldLatch = waitForFrameBarrier(output, output->bytesWritten != bytesWrittenBefore);
+			if (shouldLatch && mailbox->numOutputs > 1 && frameType != FRAME_PONG) {
+				uint8_t packet[LATCH_FRAME_PACKET_SIZE];
+				queueFpga(output, TRANSMIT_RELIABLE, packet, encodeLatchFrame(packet, output->frameNumber), 0);
+				flushFpga(output);
+			}
+			unsigned long long barrierEndTime = getNanos();
+			recordValue(&output->barrierTimes, barrierEndTime - writeEndTime);
+			writeEndTime = barrierEndTime;
+			atomicIncrement(&output->framesWritten);
+
+			// Unchanged frames are not written and have no latency
+			uint32_t frameBytes = (uint32_t) (output->bytesWritten - bytesWrittenBefore);
+			uint32_t baudRate = (uint32_t) output->baudRate;
+			if (frameBytes && baudRate) {
+				unsigned long long wireTime = writeEndTime + frameBytes * UART_BITS_PER_BYTE * 1000000000ULL / baudRate;
+				recordValue(&output->outputTimes, wireTime - publishTimeNanos);
+				updateLatency(&output->outputLatencyMicros, wireTime - publishTimeNanos);
+				if (frameType != FRAME_PONG && audioTimeNanos) {
+					recordValue(&output->pipelineTimes, wireTime - audioTimeNanos);
+					updateLatency(&output->pipelineLatencyMicros, wireTime - audioTimeNanos);
+				}
+			}
+		}
+		// A score with no frame goes out on its own
+		flushFpga(output);
+	}
 
-	DWORD bytesWritten;
-	WriteFile(hSerial, packet, 6, &bytesWritten, NULL);
+	return 0;
 }
 
-// Send updated pong score to FPGA (when point is scored)
-void setPongScore(HANDLE hSerial, uint8_t score1, uint8_t score2) {
-	uint8_t packet[4];
-	packet[0] = CMD_BYTE;
-	packet[1] = SET_PONG_SCORE_CODE;
-	packet[2] = score1;
-	packet[3] = score2;
+// Start one writer thread per FPGA port, ports is a comma-separated list of up to MAX_FPGA_OUTPUTS ports
+// Only the first output is recorded
+// Returns the number of outputs started
+uint8_t startSerialWriters(struct FrameMailbox* mailbox, char* ports, uint32_t baudRate, struct Recorder* recorder) {
+	initMutex(&mailbox->lock);
+	initCondition(&mailbox->frameReady);
+	mailbox->backIndex = 0;
+	mailbox->readyIndex = 1;
+	mailbox->frontIndex = 2;
+	mailbox->hasNewFrame = 0;
+	mailbox->audioTimeNanos = 0;
+	mailbox->frontFrameNumber = 0;
+	mailbox->completedFrameNumber = 0;
+	mailbox->numOutputsWriting = 0;
+	mailbox->frontFrameIsWritten = 0;
+	mailbox->completedFrameIsWritten = 0;
+	mailbox->isRunning = 1;
+	mailbox->framesPublished = 0;
+	mailbox->framesDropped = 0;
+	for (uint8_t i = 0; i < 3; ++i) {
+		initFramebuffer(&mailbox->frames[i].framebuffer);
+	}
+
+	mailbox->numOutputs = 0;
+	char* port = ports;
+	while (port && mailbox->numOutputs < MAX_FPGA_OUTPUTS) {
+		char* nextPort = strchr(port, ',');
+		if (nextPort) {
+			*nextPort++ = '\0';
+		}
+		if (*port) {
+			mailbox->outputs[mailbox->numOutputs++].port = port;
+		}
+		port = nextPort;
+	}
+	if (port) {
+		printf("ERROR: Only %d FPGA outputs are supported, ignoring %s\n", MAX_FPGA_OUTPUTS, port);
+	}
 
-	DWORD bytesWritten;
-	WriteFile(hSerial, packet, 4, &bytesWritten, NULL);
+	for (uint8_t i = 0; i < mailbox->numOutputs; ++i) {
+		struct FpgaOutput* output = &mailbox->outputs[i];
+		output->mailbox = mailbox;
+		output->index = i;
+		output->configuredBaudRate = baudRate;
+		output->recorder = (i == 0) ? recorder : NULL;
+		snprintf(output->name, sizeof(output->name), "FPGA %u", i);
+		initRowEncoder(&output->rowEncoder);
+		initPixelEncoder(&output->pixelEncoder);
+		output->frameNumber = 0;
+		output->pongScoreIsPending = 0;
+		output->reconnectIsRequested = 0;
+		output->histogramDumpIsRequested = 0;
+		initHistogram(&output->writeTimes, "write");
+		initHistogram(&output->barrierTimes, "frame barrier");
+		initHistogram(&output->outputTimes, "publish to wire");
+		initHistogram(&output->pipelineTimes, "audio to wire");
+		output->framesWritten = 0;
+		output->pixelTilesWritten = 0;
+		output->bytesWritten = 0;
+		output->writeTimeouts = 0;
+		output->writeErrors = 0;
+		output->serialWrites = 0;
+		output->packetsDropped = 0;
+		clearTransmitQueue(&output->transmitQueue);
+		output->isLinkBackedUp = 0;
+		output->linkErrors = 0;
+		output->creditStalls = 0;
+		output->outputLatencyMicros = 0;
+		output->pipelineLatencyMicros = 0;
+		connectFpga(output);
+	}
+	for (uint8_t i = 0; i < mailbox->numOutputs; ++i) {
+		startThread(&mailbox->outputs[i].thread, serialWriterThread, &mailbox->outputs[i]);
+	}
+	return mailbox->numOutputs;
 }
 
-// Fill global rowColors array with zeros and write to FPGA
-void setOff(HANDLE hSerial) {
-	struct RGBColor color = { 0, 0, 0 };
-	setColor(hSerial, &color);
+void stopSerialWriters(struct FrameMailbox* mailbox) {
+	lockMutex(&mailbox->lock);
+	mailbox->isRunning = 0;
+	broadcastCondition(&mailbox->frameReady);
+	unlockMutex(&mailbox->lock);
+
+	for (uint8_t i = 0; i < mailbox->numOutputs; ++i) {
+		joinThread(&mailbox->outputs[i].thread);
+		closeSerial(mailbox->outputs[i].fpgaSerial);
+	}
+	destroyMutex(&mailbox->lock);
 }
 
-HANDLE connectSerial(LPCSTR port) {
-	// Open serial port using Windows API
+// Hand the back buffer to the writer threads, replacing any frame they have not picked up yet
+void publishFrame(struct FrameMailbox* mailbox) {
+	struct Frame* frame = &mailbox->frames[mailbox->backIndex];
+	frame->audioTimeNanos = mailbox->audioTimeNanos;
+	frame->publishTimeNanos = getNanos();
+
+	lockMutex(&mailbox->lock);
+	uint8_t readyIndex = mailbox->readyIndex;
+	mailbox->readyIndex = mailbox->backIndex;
+	mailbox->backIndex = readyIndex;
+	if (mailbox->hasNewFrame) {
+		++mailbox->framesDropped;
+	}
+	mailbox->hasNewFrame = 1;
+	++mailbox->framesPublished;
+	broadcastCondition(&mailbox->frameReady);
+	unlockMutex(&mailbox->lock);
+}
 
-	HANDLE hSerial = CreateFileA(port, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+// Publish contents of global rowColors array
+// At full resolution, smooth modes blend neighbouring rows into the extra rows
+// The whole frame is scaled by gain (Q8) in one batch after expanding
+// With a cache entry, a hit is published as is and rowColors is only used to fill a miss
+void publishRowColors(struct FrameMailbox* mailbox, struct FrameCacheEntry* cachedFrame, uint8_t isSmooth, uint16_t gain) {
+	struct Frame* frame = &mailbox->frames[mailbox->backIndex];
+	if (cachedFrame) {
+		if (!cachedFrame->isValid) {
+			fillFrameCacheEntry(cachedFrame, rowColors, isSmooth, gain);
+		}
+		frame->type = FRAME_ENCODED;
+		for (uint8_t i = 0; i < FULL_LED_ROWS; ++i) {
+			frame->rowColors[i] = cachedFrame->rowColors[i];
+		}
+		for (uint8_t i = 0; i < cachedFrame->paletteSize; ++i) {
+			frame->palette[i] = cachedFrame->palette[i];
+		}
+		frame->paletteSize = cachedFrame->paletteSize;
+		frame->packetSize = cachedFrame->packetSize;
+		for (uint16_t i = 0; i < cachedFrame->packetSize; ++i) {
+			frame->packet[i] = cachedFrame->packet[i];
+		}
+		publishFrame(mailbox);
+		return;
+	}
 
-	if (hSerial == INVALID_HANDLE_VALUE) {
-		printf("ERROR: Failed to open serial port %s\n", port);
+	frame->type = FRAME_ROWS;
+	if (USE_FULL_RES_ROWS) {
+		expandRowColors(rowColors, frame->rowColors, isSmooth);
 	}
 	else {
-		printf("Successfully opened serial port %s\n", port);
+		for (uint8_t i = 0; i < LED_ROWS; ++i) {
+			frame->rowColors[i] = rowColors[i];
+		}
 	}
+	scaleColors(frame->rowColors, USE_FULL_RES_ROWS ? FULL_LED_ROWS : LED_ROWS, gain);
+	publishFrame(mailbox);
+}
 
-	COMMTIMEOUTS timeouts = { 0 };
-	timeouts.ReadIntervalTimeout = 0;
-	timeouts.ReadTotalTimeoutConstant = 100;
-	timeouts.ReadTotalTimeoutMultiplier = 0;
-	timeouts.WriteTotalTimeoutConstant = 100;
-	timeouts.WriteTotalTimeoutMultiplier = 0;
-	SetCommTimeouts(hSerial, &timeouts);
+// Renderers draw straight into the back buffer, which publishPixels then hands over
+struct Framebuffer* getBackFramebuffer(struct FrameMailbox* mailbox) {
+	return &mailbox->frames[mailbox->backIndex].framebuffer;
+}
 
-	DCB state = { 0 };
-	state.DCBlength = sizeof(DCB);
-	state.BaudRate = 115200;
-	state.ByteSize = 8;
-	state.Parity = NOPARITY;
-	state.StopBits = ONESTOPBIT;
-	SetCommState(hSerial, &state);
+void publishPixels(struct FrameMailbox* mailbox) {
+	mailbox->frames[mailbox->backIndex].type = FRAME_PIXELS;
+	publishFrame(mailbox);
+}
 
-	return hSerial;
+void publishPongData(struct FrameMailbox* mailbox, uint8_t* pongData) {
+	struct Frame* frame = &mailbox->frames[mailbox->backIndex];
+	frame->type = FRAME_PONG;
+	for (uint8_t i = 0; i < 4; ++i) {
+		frame->pongData[i] = pongData[i];
+	}
+	publishFrame(mailbox);
 }
 
-int main() {
-	initSinLut();
+// The slowest output decides when all panels show a frame
+AtomicInt getOutputLatencyMicros(struct FrameMailbox* mailbox) {
+	AtomicInt latency = 0;
+	for (uint8_t i = 0; i < mailbox->numOutputs; ++i) {
+		AtomicInt outputLatency = atomicLoad(&mailbox->outputs[i].outputLatencyMicros);
+		if (outputLatency > latency) {
+			latency = outputLatency;
+		}
+	}
+	return latency;
+}
 
-	HANDLE fpgaSerial = connectSerial("\\\\.\\COM4");  // For interfacing with LEDs
-	HANDLE arduinoSerial = connectSerial("\\\\.\\COM5");  // For interfacing with Arduino beat tracking
+// Scores are never dropped, only the latest one is sent
+void publishPongScore(struct FrameMailbox* mailbox, uint8_t score1, uint8_t score2) {
+	lockMutex(&mailbox->lock);
+	mailbox->pongScore[0] = score1;
+	mailbox->pongScore[1] = score2;
+	for (uint8_t i = 0; i < mailbox->numOutputs; ++i) {
+		mailbox->outputs[i].pongScoreIsPending = 1;
+	}
+	broadcastCondition(&mailbox->frameReady);
+	unlockMutex(&mailbox->lock);
+}
 
-	struct timeb start, end;
-	ftime(&start);
-	long millis = 0;
+// Each writer thread prints and resets its own histograms
+void requestWriterHistogramDump(struct FrameMailbox* mailbox) {
+	lockMutex(&mailbox->lock);
+	for (uint8_t i = 0; i < mailbox->numOutputs; ++i) {
+		mailbox->outputs[i].histogramDumpIsRequested = 1;
+	}
+	broadcastCondition(&mailbox->frameReady);
+	unlockMutex(&mailbox->lock);
+}
+
+void requestFpgaReconnect(struct FrameMailbox* mailbox) {
+	lockMutex(&mailbox->lock);
+	for (uint8_t i = 0; i < mailbox->numOutputs; ++i) {
+		mailbox->outputs[i].reconnectIsRequested = 1;
+	}
+	broadcastCondition(&mailbox->frameReady);
+	unlockMutex(&mailbox->lock);
+}
+
+THREAD_FUNC(audioReaderThread) {
+	struct AudioRing* ring = (struct AudioRing*) param;
+	uint8_t buffer[AUDIO_READ_CHUNK_SIZE];
+
+	while (atomicLoad(&ring->isRunning)) {
+		if (atomicExchange(&ring->reconnectIsRequested, 0)) {
+			closeSerial(ring->arduinoSerial);
+			ring->arduinoSerial = connectSerial(ring->port, ring->baudRate);
+		}
+
+		// Drain everything the driver has buffered in one call
+		int32_t bytesRead = readSerial(ring->arduinoSerial, buffer, AUDIO_READ_CHUNK_SIZE);
+		if (bytesRead < 0) {
+			sleepMillis(SERIAL_TIMEOUT_MS);  // Port is gone, wait for a reconnect
+			continue;
+		}
+		if (!bytesRead) {
+			continue;
+		}
+
+		unsigned long long timeNanos = getNanos();
+		recordData(ring->recorder, RECORD_ARDUINO_BYTES, timeNanos, buffer, (uint16_t) bytesRead);
+		AtomicInt writeCount = ring->writeCount;
+		for (int32_t i = 0; i < bytesRead; ++i) {
+			struct AudioSample* sample = &ring->samples[(writeCount + i) & (AUDIO_RING_SIZE - 1)];
+			sample->level = buffer[i];
+			sample->timeNanos = timeNanos;
+		}
+
+		// Release store makes the samples visible before the new count
+		atomicStore(&ring->writeCount, writeCount + bytesRead);
+	}
+
+	return 0;
+}
 
-	unsigned long frameTime = 0;
+// Analyze PCM in hops, each hop becomes one sample with its beat flag and band levels
+// File input is paced to its sample rate, live input paces itself
+THREAD_FUNC(pcmReaderThread) {
+	struct AudioRing* ring = (struct AudioRing*) param;
+	struct PcmSource source;
+	if (!openPcmSource(&source, ring->pcmPath)) {
+		printf("ERROR: Failed to open PCM input %s\n", ring->pcmPath);
+		return 0;
+	}
+	printf(
+		"Analyzing PCM input %s at %u Hz, %u channels, %.1f ms per hop, beats lag the input by %.1f ms\n",
+		ring->pcmPath, source.sampleRate, source.numChannels,
+		1000.0 * BEAT_HOP_SIZE / source.sampleRate, 1000.0 * BEAT_FFT_SIZE / 2 / source.sampleRate
+	);
+
+	struct BeatDetector* detector = (struct BeatDetector*) malloc(sizeof(struct BeatDetector));
+	initBeatDetector(detector, source.sampleRate);
+	float hop[BEAT_HOP_SIZE];
+	unsigned long long startTime = getNanos();
+	unsigned long long numFramesRead = 0;
+
+	while (atomicLoad(&ring->isRunning)) {
+		if (readPcm(&source, hop, BEAT_HOP_SIZE) < BEAT_HOP_SIZE) {
+			printf("PCM input %s ended\n", ring->pcmPath);
+			break;
+		}
+		numFramesRead += BEAT_HOP_SIZE;
+
+		struct AudioFeatures features;
+		analyzeHop(detector, hop, &features);
+
+		AtomicInt writeCount = ring->writeCount;
+		struct AudioSample* sample = &ring->samples[writeCount & (AUDIO_RING_SIZE - 1)];
+		sample->level = features.level;
+		sample->isBeat = features.isBeat;
+		for (uint8_t i = 0; i < NUM_AUDIO_BANDS; ++i) {
+			sample->bandLevels[i] = features.bandLevels[i];
+		}
+		sample->timeNanos = getNanos();
+		atomicStore(&ring->writeCount, writeCount + 1);
+
+		unsigned long long hopEndTime = startTime + numFramesRead * 1000000000 / source.sampleRate;
+		unsigned long long now = getNanos();
+		if (hopEndTime > now + 1000000) {
+			sleepMillis((uint32_t) ((hopEndTime - now) / 1000000));
+		}
+	}
+
+	free(detector);
+	closePcmSource(&source);
+	return 0;
+}
+
+// Start reader thread that owns the Arduino serial port, or analyzes PCM for a "pcm:<path>" port
+void startAudioReader(struct AudioRing* ring, const char* port, uint32_t baudRate, struct Recorder* recorder) {
+	ring->writeCount = 0;
+	ring->readCount = 0;
+	ring->reconnectIsRequested = 0;
+	ring->isRunning = 1;
+	ring->samplesConsumed = 0;
+	ring->samplesDiscarded = 0;
+	ring->port = port;
+	ring->baudRate = baudRate;
+	ring->recorder = recorder;
+	ring->pcmPath = (strncmp(port, "pcm:", 4) == 0) ? port + 4 : NULL;
+	if (ring->pcmPath) {
+		ring->arduinoSerial = INVALID_SERIAL_PORT;
+		startThread(&ring->thread, pcmReaderThread, ring);
+		return;
+	}
+	ring->arduinoSerial = connectSerial(port, baudRate);
+	startThread(&ring->thread, audioReaderThread, ring);
+}
+
+void stopAudioReader(struct AudioRing* ring) {
+	atomicStore(&ring->isRunning, 0);
+	joinThread(&ring->thread);
+	if (!ring->pcmPath) {
+		closeSerial(ring->arduinoSerial);
+	}
+}
+
+void requestArduinoReconnect(struct AudioRing* ring) {
+	if (!ring->pcmPath) {
+		atomicStore(&ring->reconnectIsRequested, 1);
+	}
+}
+
+// Copy samples received since the last call into samples, oldest first, without blocking
+// Only the newest maxSamples are returned, anything older is counted as discarded
+uint16_t consumeAudioSamples(struct AudioRing* ring, struct AudioSample* samples, uint16_t maxSamples) {
+	AtomicInt writeCount = atomicLoad(&ring->writeCount);
+
+	uint32_t numAvailable = (uint32_t) (writeCount - ring->readCount);
+	if (numAvailable > maxSamples) {
+		ring->samplesDiscarded += numAvailable - maxSamples;
+		ring->readCount = writeCount - maxSamples;
+		numAvailable = maxSamples;
+	}
+
+	for (uint32_t i = 0; i < numAvailable; ++i) {
+		samples[i] = ring->samples[(ring->readCount + i) & (AUDIO_RING_SIZE - 1)];
+	}
+
+	// Drop any samples the reader thread overwrote while they were being copied
+	memoryFence();
+	uint32_t numWrittenSinceStart = (uint32_t) (atomicLoad(&ring->writeCount) - ring->readCount);
+	uint16_t numOverwritten = 0;
+	if (numWrittenSinceStart > AUDIO_RING_SIZE) {
+		numOverwritten = (uint16_t) (numWrittenSinceStart - AUDIO_RING_SIZE);
+		if (numOverwritten > numAvailable) {
+			numOverwritten = (uint16_t) numAvailable;
+		}
+		for (uint32_t i = numOverwritten; i < numAvailable; ++i) {
+			samples[i - numOverwritten] = samples[i];
+		}
+		ring->samplesDiscarded += numOverwritten;
+	}
+
+	ring->readCount = writeCount;
+	ring->samplesConsumed += numAvailable - numOverwritten;
+	return (uint16_t) (numAvailable - numOverwritten);
+}
+
+int main(int argc, char** argv) {
+	// Usage: ddf_controller [FPGA port[,FPGA port...]] [Arduino port] [FPGA baud rate] [Arduino baud rate] [record log]
+	char fpgaPorts[256];  // For interfacing with LEDs, one port per panel
+	snprintf(fpgaPorts, sizeof(fpgaPorts), "%s", (argc > 1) ? argv[1] : DEFAULT_FPGA_PORT);
+	const char* arduinoPort = (argc > 2) ? argv[2] : DEFAULT_ARDUINO_PORT;  // For interfacing with Arduino beat tracking, or pcm:<WAV file, FIFO or - for stdin>
+	uint32_t fpgaBaudRate = (argc > 3) ? (uint32_t) strtoul(argv[3], NULL, 10) : 0;  // 0 to probe
+	uint32_t arduinoBaudRate = (argc > 4) ? (uint32_t) strtoul(argv[4], NULL, 10) : SERIAL_BAUD_RATE;
+	if (!arduinoBaudRate) {
+		arduinoBaudRate = SERIAL_BAUD_RATE;
+	}
+	const char* recordPath = (argc > 5) ? argv[5] : NULL;  // Log of all serial traffic for ddf_replay
 
-	uint8_t keyWasPressed[NUM_KEYS] = { 0 };
+	struct Recorder recorder;
+	if (!openRecorder(&recorder, recordPath)) {
+		printf("ERROR: Failed to create record log %s\n", recordPath);
+	}
+
+	initSineTable();
+	initPlasmaRingPhases();
+	initLinkCrcTable();
+
+	static struct FrameMailbox fpgaMailbox;  // Holds full framebuffers, too large for the stack
+	if (!startSerialWriters(&fpgaMailbox, fpgaPorts, fpgaBaudRate, &recorder)) {
+		printf("ERROR: No FPGA port given\n");
+		closeRecorder(&recorder);
+		return 1;
+	}
+	struct AudioRing audioRing;
+	startAudioReader(&audioRing, arduinoPort, arduinoBaudRate, &recorder);
+	struct InputQueue inputQueue;
+	if (strcmp(arduinoPort, "pcm:-") == 0) {
+		initInputQueue(&inputQueue);  // stdin carries audio, not keys
+	}
+	else {
+		startInputThread(&inputQueue);
+	}
+
+	unsigned long long startTime = getNanos();
+	long millis = 0;
+
+	// Frame timing, printed and reset with the H key
+	struct Histogram renderTimes;
+	struct Histogram loopPeriods;
+	struct Histogram audioAges;
+	struct Histogram inputAges;
+	initHistogram(&renderTimes, "render");
+	initHistogram(&loopPeriods, "loop");
+	initHistogram(&audioAges, "audio age");
+	initHistogram(&inputAges, "input age");
+	unsigned long long loopStartTime = startTime;
+	unsigned long long lastRecordFlushTime = startTime;
+
+	// Live metrics for external tools
+	struct SharedMemory metricsMemory;
+	struct MetricsSegment* metrics = createMetrics(&metricsMemory);
+	if (!metrics) {
+		printf("ERROR: Failed to create metrics segment %s\n", METRICS_NAME);
+	}
+	uint32_t framesRendered = 0;
+	uint32_t renderMilliFps = 0;
+	uint32_t writeMilliFps = 0;
+	unsigned long long fpsPeriodStartTime = startTime;
+	uint32_t fpsPeriodStartFramesRendered = 0;
+	uint32_t fpsPeriodStartFramesWritten = 0;
+
+	uint8_t keyWasPressed[NUM_INPUT_KEYS] = { 0 };
 	uint8_t isAcceptingInput = 1;
 
 	enum ColorMode colorMode = RED;
 	enum AnimationMode animationMode = ANIMATION_OFF;
-	long animationStartTime = 0;
 	struct RGBColor solidColor = { 0, 0, 0 };
 	double audioLevel = MIN_AUDIO_LEVEL;
 	uint8_t hasChangedRainbow = 0;
+	uint8_t audioBandLevels[NUM_AUDIO_BANDS] = { 0 };
+	uint32_t beatsDetected = 0;
+	struct EnvelopePredictor audioEnvelope;
+	struct BeatPredictor beatPredictor;
+	initEnvelopePredictor(&audioEnvelope);
+	initBeatPredictor(&beatPredictor);
 	double brightness = 1.0;
 
-	double waveBrightnesses[WAVE_SIZE] = { 0 };
+	uint16_t waveBrightnesses[WAVE_SIZE] = { 0 };
 	double fadeBrightness = 0;  // [0, 1] multiplier
 	long rainbowPeriodStartTime = 0;
 	uint8_t rainbowSegment = 0;
-	struct WaveData waveData[MAX_NUM_WAVES];
-	uint8_t nextWaveIndex = 0;
+	struct WavePool wavePool;
+	initWavePool(&wavePool);
+
+	// Per-pixel modes render on all cores
+	static struct RenderPool renderPool;
+	startRenderPool(&renderPool, RENDER_THREADS);
+	printf("Per-pixel render threads: %u\n", renderPool.numThreads);
+	struct FrameCache frameCache;
+	initFrameCache(&frameCache);
 
 	// Pong
 	struct Paddle paddle1;
 	struct Paddle paddle2;
 	struct Ball ball;
 	resetPong(&paddle1, &paddle2, &ball, 1);
+	uint8_t publishedPongData[4] = { 0 };
+	uint8_t publishedPongDataIsValid = 0;
 	paddle1.color = white;
 	paddle2.color = white;
 	ball.color = white;
 
-	const double RAINBOW_OMEGA = 2 * PI / (2 * RAINBOW_PERIOD_MS / 3.0);
+	// Color mode oscillators, advanced by the elapsed time every loop
+	long lastMillis = 0;
+	struct Oscillator rainbowOscillator;  // One period of the sinusoid is 2/3 the period of the rainbow animation
+	struct Oscillator twoColorOscillator;  // RED_BLUE and GREEN_BLUE
+	struct Oscillator alternatingOscillator;
+	struct Oscillator plasmaOscillator;
+	initOscillator(&rainbowOscillator, 2 * RAINBOW_PERIOD_MS / 3.0);
+	initOscillator(&twoColorOscillator, RAINBOW_PERIOD_MS);
+	initOscillator(&alternatingOscillator, ALTERNATING_PERIOD_MS);
+	initOscillator(&plasmaOscillator, PLASMA_PERIOD_MS);
 
 	// Initialize wave brightness levels
-	for (uint8_t i = 0; i < WAVE_SIZE; ++i) {
-		waveBrightnesses[i] = getSinLut(i / (double) WAVE_SIZE * PI);
-	}
-
-	// Initialize wave data
-	for (uint8_t i = 0; i < MAX_NUM_WAVES; ++i) {
-		waveData[i].animationStartingTime = 0;
-		waveData[i].direction = 0;
-		waveData[i].focus = 0;
-		waveData[i].animationIsFinished = 1;
-	}
+	initWaveBrightnesses(waveBrightnesses);
 
 	while (1) {
-		ftime(&end);
-		millis = (long) (1000.0 * (end.time - start.time) + (end.millitm - start.millitm));
-
-		// Get audio level via Arduino serial
-		uint8_t arduinoSerialByte;
-		DWORD arduinoBytesRead = 0;
-		if (ReadFile(arduinoSerial, &arduinoSerialByte, 1, &arduinoBytesRead, NULL) && arduinoBytesRead) {
-			if (GetKeyState('P') & 0x8000) {
+		unsigned long long now = getNanos();
+		recordValue(&loopPeriods, now - loopStartTime);
+		loopStartTime = now;
+		millis = (long) ((now - startTime) / 1000000);
+
+		uint32_t elapsedMillis = (uint32_t) (millis - lastMillis);
+		lastMillis = millis;
+		advanceOscillator(&rainbowOscillator, elapsedMillis);
+		advanceOscillator(&twoColorOscillator, elapsedMillis);
+		advanceOscillator(&alternatingOscillator, elapsedMillis);
+		advanceOscillator(&plasmaOscillator, elapsedMillis);
+
+		// Get audio level via Arduino serial, or beats and band levels from PCM analysis
+		struct AudioSample audioSamples[AUDIO_MAX_SAMPLES_PER_FRAME];
+		uint16_t numAudioSamples = consumeAudioSamples(&audioRing, audioSamples, AUDIO_MAX_SAMPLES_PER_FRAME);
+		unsigned long long audioTime = getNanos();  // Samples can be newer than now
+		for (uint16_t i = 0; i < numAudioSamples; ++i) {
+			recordValue(&audioAges, audioTime - audioSamples[i].timeNanos);
+			uint8_t arduinoSerialByte = audioSamples[i].level;
+			if (keyWasPressed['P']) {
 				printf("Arduino serial byte: %d\n", arduinoSerialByte);
 			}
 			
@@ -373,15 +1115,49 @@ int main() {
 			newAudioLevel += MIN_AUDIO_LEVEL;  // [MIN_AUDIO_LEVEL, 1]
 
 			audioLevel = 0.45 * audioLevel + 0.55 * newAudioLevel;
-
-			if (audioLevel <= COLOR_CHANGE_THRESHOLD) {
+			updateEnvelope(&audioEnvelope, audioLevel, audioSamples[i].timeNanos);
+			fpgaMailbox.audioTimeNanos = audioSamples[i].timeNanos;
+
+			// Color changes follow beats when they are detected, otherwise the level dropping below the threshold
+			// Beats the scheduler already acted on early are not acted on again
+			if (audioRing.pcmPath) {
+				if (audioSamples[i].isBeat) {
+					if (observeBeat(&beatPredictor, audioSamples[i].timeNanos)) {
+						hasChangedRainbow = 0;
+					}
+					++beatsDetected;
+				}
+				for (uint8_t j = 0; j < NUM_AUDIO_BANDS; ++j) {
+					audioBandLevels[j] = audioSamples[i].bandLevels[j];
+				}
+			}
+			else if (audioLevel <= COLOR_CHANGE_THRESHOLD) {
 				hasChangedRainbow = 0;
 			}
 		}
 
-		// Loop through ASCII characters
-		for (uint8_t i = 1; i < NUM_KEYS; ++i) {
-			if ((GetKeyState(i) & 0x8000) && !keyWasPressed[i]) {
+		// Render for when the frame will be on the wire, not for now
+		unsigned long long scheduledTime = now;
+		if (USE_PREDICTIVE_SCHEDULING) {
+			unsigned long long outputLatency = (unsigned long long) getOutputLatencyMicros(&fpgaMailbox) * 1000;
+			if (outputLatency > MAX_PREDICTION_MS * 1000000ULL) {
+				outputLatency = MAX_PREDICTION_MS * 1000000ULL;
+			}
+			scheduledTime += outputLatency;
+			if (audioRing.pcmPath && isBeatDue(&beatPredictor, scheduledTime)) {
+				hasChangedRainbow = 0;
+			}
+		}
+		double scheduledAudioLevel = USE_PREDICTIVE_SCHEDULING ? predictEnvelope(&audioEnvelope, scheduledTime) : audioLevel;
+
+		// Handle key changes seen by the input thread since the last frame
+		struct InputEvent inputEvents[INPUT_MAX_EVENTS_PER_FRAME];
+		uint16_t numInputEvents = consumeInputEvents(&inputQueue, inputEvents, INPUT_MAX_EVENTS_PER_FRAME);
+		unsigned long long inputTime = getNanos();  // Events can be newer than now
+		for (uint16_t j = 0; j < numInputEvents; ++j) {
+			uint8_t i = inputEvents[j].key;
+			recordValue(&inputAges, inputTime - inputEvents[j].timeNanos);
+			if (inputEvents[j].isPressed && !keyWasPressed[i]) {
 				// Pressed
 
 				if (i == 17) {
@@ -392,7 +1168,19 @@ int main() {
 
 				if (isAcceptingInput) {
 					keyWasPressed[i] = 1;
-					printf("Pressed: %u\n", i);
+
+					if (i == 'H') {
+						// Dump frame timing since the last dump
+						printHistogram(&loopPeriods);
+						printHistogram(&renderTimes);
+						printHistogram(&audioAges);
+						printHistogram(&inputAges);
+						resetHistogram(&loopPeriods);
+						resetHistogram(&renderTimes);
+						resetHistogram(&audioAges);
+						resetHistogram(&inputAges);
+						requestWriterHistogramDump(&fpgaMailbox);
+					}
 
 					if (i == 'G') {
 						// Toggle pong
@@ -402,7 +1190,10 @@ int main() {
 						else {
 							animationMode = ANIMATION_PONG;
 							resetPongAndScore(&paddle1, &paddle2, &ball);
-							setPongScore(fpgaSerial, paddle1.score, paddle2.score);
+							pongStart = getNanos();
+							pongLag = 0;
+							publishedPongDataIsValid = 0;
+							publishPongScore(&fpgaMailbox, paddle1.score, paddle2.score);
 						}
 					}
 
@@ -412,14 +1203,14 @@ int main() {
 							if (colorMode == RAINBOW || colorMode == RED_BLUE || colorMode == GREEN_BLUE) {
 								rainbowPeriodStartTime = millis;
 								rainbowSegment = 0;
+								resetOscillator(&rainbowOscillator);
+								resetOscillator(&twoColorOscillator);
 							}
 						}
 						else if (i == 'L') {
 							// Reconnect serial
-							CloseHandle(fpgaSerial);
-							CloseHandle(arduinoSerial);
-							fpgaSerial = connectSerial("\\\\.\\COM4");
-							arduinoSerial = connectSerial("\\\\.\\COM5");
+							requestArduinoReconnect(&audioRing);
+							requestFpgaReconnect(&fpgaMailbox);
 						}
 						else if (i == 37) {
 							brightness -= 0.05;
@@ -449,7 +1240,6 @@ int main() {
 							}
 							else {
 								animationMode = ANIMATION_RAINBOW;
-								animationStartTime = millis;
 							}
 						}
 						else if (i == 'C') {
@@ -460,36 +1250,39 @@ int main() {
 								animationMode = ANIMATION_ALTERNATING;
 							}
 						}
+						else if (i == 'V') {
+							// Toggle spectrum
+							if (animationMode == ANIMATION_SPECTRUM) {
+								animationMode = ANIMATION_OFF;
+							}
+							else {
+								animationMode = ANIMATION_SPECTRUM;
+							}
+						}
+						else if (i == 'B') {
+							// Toggle plasma
+							if (animationMode == ANIMATION_PLASMA) {
+								animationMode = ANIMATION_OFF;
+							}
+							else {
+								animationMode = ANIMATION_PLASMA;
+							}
+						}
 						else if (i == 38 || i == 40) {
 							// Wave
 
 							animationMode = ANIMATION_WAVE;
 
-							struct WaveData newWaveData;
-							newWaveData.animationStartingTime = millis;
-							if (i == 38) {
-								newWaveData.direction = WAVE_DIR_UP;
-								newWaveData.focus = LED_ROWS - 1;
-							}
-							else {
-								newWaveData.direction = WAVE_DIR_DOWN;
-								newWaveData.focus = 0;
-							}
-							newWaveData.animationIsFinished = 0;
-							waveData[nextWaveIndex] = newWaveData;
-
-							++nextWaveIndex;
-							if (nextWaveIndex >= MAX_NUM_WAVES) {
-								nextWaveIndex = 0;
+							if (!addWave(&wavePool, (i == 38) ? WAVE_DIR_UP : WAVE_DIR_DOWN, millis)) {
+								printf("ERROR: Out of memory for waves\n");
 							}
 						}
 					}
 				}
 			}
-			else if (!(GetKeyState(i) & 0x8000) && keyWasPressed[i]) {
+			else if (!inputEvents[j].isPressed && keyWasPressed[i]) {
 				// Released
 				keyWasPressed[i] = 0;
-				printf("Released: %u\n", i);
 			}
 		}
 
@@ -549,25 +1342,28 @@ int main() {
 			}
 			else {
 				if (millis - rainbowPeriodStartTime < RAINBOW_PERIOD_MS / 3) {
-					double cosine = getCosLut(RAINBOW_OMEGA * (millis - rainbowPeriodStartTime));
+					uint8_t rising = (uint8_t) getScaledCosine(rainbowOscillator.phase, 20, 20);
+					uint8_t falling = (uint8_t) getScaledCosine(rainbowOscillator.phase + PHASE_HALF, 20, 20);
 					if (rainbowSegment == 0) {
-						solidColor.r = (uint8_t)(20 * cosine + 20);
-						solidColor.g = (uint8_t)(20 * -cosine + 20);
+						solidColor.r = rising;
+						solidColor.g = falling;
 						solidColor.b = 0;
 					}
 					else if (rainbowSegment == 1) {
 						solidColor.r = 0;
-						solidColor.g = (uint8_t)(20 * cosine + 20);
-						solidColor.b = (uint8_t)(20 * -cosine + 20);
+						solidColor.g = rising;
+						solidColor.b = falling;
 					}
 					else if (rainbowSegment == 2) {
-						solidColor.r = (uint8_t)(20 * -cosine + 20);
+						solidColor.r = falling;
 						solidColor.g = 0;
-						solidColor.b = (uint8_t)(20 * cosine + 20);
+						solidColor.b = rising;
 					}
 				}
 				else {
 					rainbowPeriodStartTime = millis;
+					resetOscillator(&rainbowOscillator);
+					resetOscillator(&twoColorOscillator);
 					++rainbowSegment;
 					if (rainbowSegment > 2) {
 						rainbowSegment = 0;
@@ -595,16 +1391,15 @@ int main() {
 			}
 			else {
 				if (millis - rainbowPeriodStartTime < RAINBOW_PERIOD_MS / 3) {
-					solidColor.r = (uint8_t)(
-						20 * getCosLut(2 * PI / RAINBOW_PERIOD_MS * (millis - rainbowPeriodStartTime) + ((rainbowSegment == 0) ? 0 : PI)) + 20
-					);
+					uint32_t phase = twoColorOscillator.phase + ((rainbowSegment == 0) ? 0 : PHASE_HALF);
+					solidColor.r = (uint8_t) getScaledCosine(phase, 20, 20);
 					solidColor.g = 0;
-					solidColor.b = (uint8_t)(
-						20 * getCosLut(2 * PI / RAINBOW_PERIOD_MS * (millis - rainbowPeriodStartTime) + ((rainbowSegment == 0) ? PI : 0)) + 20
-					);
+					solidColor.b = (uint8_t) getScaledCosine(phase + PHASE_HALF, 20, 20);
 				}
 				else {
 					rainbowPeriodStartTime = millis;
+					resetOscillator(&rainbowOscillator);
+					resetOscillator(&twoColorOscillator);
 					++rainbowSegment;
 					if (rainbowSegment > 1) {
 						rainbowSegment = 0;
@@ -632,16 +1427,15 @@ int main() {
 			}
 			else {
 				if (millis - rainbowPeriodStartTime < RAINBOW_PERIOD_MS / 3) {
+					uint32_t phase = twoColorOscillator.phase + ((rainbowSegment == 0) ? 0 : PHASE_HALF);
 					solidColor.r = 0;
-					solidColor.g = (uint8_t)(
-						20 * getCosLut(2 * PI / RAINBOW_PERIOD_MS * (millis - rainbowPeriodStartTime) + ((rainbowSegment == 0) ? 0 : PI)) + 20
-					);
-					solidColor.b = (uint8_t)(
-						20 * getCosLut(2 * PI / RAINBOW_PERIOD_MS * (millis - rainbowPeriodStartTime) + ((rainbowSegment == 0) ? PI : 0)) + 20
-						);
+					solidColor.g = (uint8_t) getScaledCosine(phase, 20, 20);
+					solidColor.b = (uint8_t) getScaledCosine(phase + PHASE_HALF, 20, 20);
 				}
 				else {
 					rainbowPeriodStartTime = millis;
+					resetOscillator(&rainbowOscillator);
+					resetOscillator(&twoColorOscillator);
 					++rainbowSegment;
 					if (rainbowSegment > 1) {
 						rainbowSegment = 0;
@@ -651,210 +1445,239 @@ int main() {
 			break;
 		}
 
-		solidColor.r = (uint8_t)(solidColor.r * brightness);
-		solidColor.g = (uint8_t)(solidColor.g * brightness);
-		solidColor.b = (uint8_t)(solidColor.b * brightness);
-
 		// Adjust brightness based on audio level
-		if (animationMode != ANIMATION_WAVE) {
-			solidColor.r = (uint8_t)(solidColor.r * audioLevel);
-			solidColor.g = (uint8_t)(solidColor.g * audioLevel);
-			solidColor.b = (uint8_t)(solidColor.b * audioLevel);
+		double gain = brightness;
+		if (animationMode != ANIMATION_WAVE && animationMode != ANIMATION_SPECTRUM && animationMode != ANIMATION_RAINBOW) {
+			gain *= scheduledAudioLevel;
 		}
+		// Row modes are rendered at full gain and scaled as a whole frame on publish
+		// Alternating has a fixed level and off is black at any gain
+		uint16_t rowGain = (animationMode == ANIMATION_ALTERNATING || animationMode == ANIMATION_OFF) ? Q8_ONE : toQ8(gain);
+
+		unsigned long long renderStartTime = getNanos();
+
+		// Cache hits skip rendering here and encoding in the writer thread
+		struct FrameCacheEntry* cachedFrame = NULL;
+		if (USE_FRAME_CACHE && USE_FULL_RES_ROWS && isFrameCacheable(animationMode)) {
+			rowGain = (uint16_t) ((rowGain + FRAME_CACHE_GAIN_STEP / 2) / FRAME_CACHE_GAIN_STEP * FRAME_CACHE_GAIN_STEP);
+			struct FrameCacheKey frameCacheKey = { 0 };
+			frameCacheKey.animationMode = (uint8_t) animationMode;
+			frameCacheKey.colorMode = (uint8_t) colorMode;
+			frameCacheKey.brightness = (uint32_t) (brightness * 65536 + 0.5);
+			frameCacheKey.gain = rowGain;
+			if (animationMode == ANIMATION_SOLID) {
+				frameCacheKey.color = solidColor;
+			}
+			else if (animationMode == ANIMATION_ALTERNATING) {
+				frameCacheKey.phaseBucket = alternatingOscillator.phase >> (32 - FRAME_CACHE_PHASE_BITS);
+			}
+			cachedFrame = lookupFrame(&frameCache, &frameCacheKey);
+		}
+		uint8_t shouldRender = !cachedFrame || !cachedFrame->isValid;
 
-		uint8_t sine1 = 0;
-		uint8_t sine2 = 0;
 		switch (animationMode) {
 		case ANIMATION_OFF:
-			setOff(fpgaSerial);
+			if (shouldRender) {
+				setOff();
+			}
+			publishRowColors(&fpgaMailbox, cachedFrame, 0, rowGain);
 			break;
 		case ANIMATION_SOLID:
-			setColor(fpgaSerial, &solidColor);
+			if (shouldRender) {
+				setColor(&solidColor);
+			}
+			publishRowColors(&fpgaMailbox, cachedFrame, 0, rowGain);
 			break;
 		case ANIMATION_WAVE:
-			// Clear rowColors
-			for (uint8_t i = 0; i < LED_ROWS; ++i) {
-				rowColors[i].r = 0;
-				rowColors[i].g = 0;
-				rowColors[i].b = 0;
-			}
-
-			for (uint8_t i = 0; i < MAX_NUM_WAVES; ++i) {
-				if (waveData[i].animationIsFinished) {
-					continue;
-				}
-
-				if (waveData[i].direction == WAVE_DIR_DOWN) {
-					waveData[i].focus = (uint8_t)((millis - waveData[i].animationStartingTime) * WAVE_SPEED);
-					if (waveData[i].focus >= LED_ROWS + WAVE_SIZE - 1) {
-						waveData[i].animationIsFinished = 1;
-						continue;
-					}
-					for (int8_t j = 0; j < LED_ROWS; ++j) {
-						if (j <= waveData[i].focus && j > waveData[i].focus - WAVE_SIZE) {
-							double rowBrightness = waveBrightnesses[waveData[i].focus - j];
-							rowColors[j].r += (uint8_t)(solidColor.r * rowBrightness);
-							rowColors[j].g += (uint8_t)(solidColor.g * rowBrightness);
-							rowColors[j].b += (uint8_t)(solidColor.b * rowBrightness);
-						}
-					}
-				}
-				else {
-					waveData[i].focus = LED_ROWS - 1 - (uint8_t)((millis - waveData[i].animationStartingTime) * WAVE_SPEED);
-					if (waveData[i].focus <= -WAVE_SIZE) {
-						waveData[i].animationIsFinished = 1;
-						continue;
-					}
-					for (int8_t j = 0; j < LED_ROWS; ++j) {
-						if (j >= waveData[i].focus && j < waveData[i].focus + WAVE_SIZE) {
-							double rowBrightness = waveBrightnesses[j - waveData[i].focus];
-							rowColors[j].r += (uint8_t)(solidColor.r * rowBrightness);
-							rowColors[j].g += (uint8_t)(solidColor.g * rowBrightness);
-							rowColors[j].b += (uint8_t)(solidColor.b * rowBrightness);
-						}
-					}
-				}
-			}
-			setRowColors(fpgaSerial);
+			renderWaves(rowColors, &wavePool, waveBrightnesses, &solidColor, millis);
+			publishRowColors(&fpgaMailbox, NULL, 1, rowGain);
 			break;
 		case ANIMATION_RAINBOW:
-			for (uint8_t i = 0; i < LED_ROWS; ++i) {
-				uint8_t adjustedI = i;//(uint8_t)(i + (millis - animationStartTime) / 12.0);
-				while (adjustedI >= LED_ROWS) {
-					adjustedI -= LED_ROWS;
-				}
-				if (adjustedI<= LED_ROWS / 3) {
-					double cosine = getCosLut((double)adjustedI / LED_ROWS * 2 * PI);
-					rowColors[i].r = (uint8_t)((20 * cosine + 20) * brightness );
-					rowColors[i].g = (uint8_t)((20 * -cosine + 20) * brightness);
-					rowColors[i].b = 0;
-				}
-				else if (adjustedI <= 2 * LED_ROWS / 3) {
-					double cosine = getCosLut((double)adjustedI / LED_ROWS * 2 * PI - 2 * PI / 3);
-					rowColors[i].r = 0;
-					rowColors[i].g = (uint8_t)((20 * cosine + 20) * brightness);
-					rowColors[i].b = (uint8_t)((20 * -cosine + 20) * brightness);
-				}
-				else {
-					double cosine = getCosLut((double)adjustedI / LED_ROWS * 2 * PI - 4 * PI / 3);
-					rowColors[i].r = (uint8_t)((20 * -cosine + 20) * brightness);
-					rowColors[i].g = 0;
-					rowColors[i].b = (uint8_t)((20 * cosine + 20) * brightness);
-				}
+			if (shouldRender) {
+				renderRainbow(rowColors);
 			}
-			setRowColors(fpgaSerial);
+			publishRowColors(&fpgaMailbox, cachedFrame, 1, rowGain);
 			break;
 		case ANIMATION_ALTERNATING:
-			sine1 = (uint8_t)(20 * getSinLut(2 * PI / 600 * millis) + 20);
-			sine2 = (uint8_t)(20 * getSinLut(2 * PI / 600 * millis + PI / 2) + 20);
-			for (uint8_t i = 0; i < LED_ROWS; ++i) {
-				if (i % 2 == 0) {
-					rowColors[i].r = sine1;
-					rowColors[i].g = 0;
-					rowColors[i].b = sine2;
-				}
-				else {
-					rowColors[i].r = sine2;
-					rowColors[i].g = 0;
-					rowColors[i].b = sine1;
-				}
+			if (shouldRender) {
+				renderAlternating(rowColors, cachedFrame ? FRAME_CACHE_PHASE(cachedFrame->key.phaseBucket) : alternatingOscillator.phase);
 			}
-			setRowColors(fpgaSerial);
+			publishRowColors(&fpgaMailbox, cachedFrame, 0, rowGain);
 			break;
+		case ANIMATION_SPECTRUM: {
+			// Band levels come from PCM analysis, the Arduino only gives one level for the whole panel
+			uint8_t level = (uint8_t) (scheduledAudioLevel * 255);
+			struct SpectrumParams spectrumParams;
+			spectrumParams.levels = audioRing.pcmPath ? audioBandLevels : &level;
+			spectrumParams.numLevels = audioRing.pcmPath ? NUM_AUDIO_BANDS : 1;
+			struct RGBColor spectrumColor = solidColor;
+			scaleColors(&spectrumColor, 1, toQ8(gain));
+			spectrumParams.color.g = spectrumColor.g;
+			spectrumParams.color.r = spectrumColor.r;
+			spectrumParams.color.b = spectrumColor.b;
+			renderTiles(&renderPool, getBackFramebuffer(&fpgaMailbox), renderSpectrumTile, &spectrumParams);
+			publishPixels(&fpgaMailbox);
+			break;
+		}
+		case ANIMATION_PLASMA: {
+			struct PlasmaParams plasmaParams;
+			plasmaParams.phase = plasmaOscillator.phase;
+			plasmaParams.gain = toQ8(gain * PLASMA_BRIGHTNESS);
+			renderTiles(&renderPool, getBackFramebuffer(&fpgaMailbox), renderPlasmaTile, &plasmaParams);
+			publishPixels(&fpgaMailbox);
+			break;
+		}
 		case ANIMATION_PONG:
-			pongEnd = getMicros();
-			frameTime = (unsigned long) (pongEnd - pongStart);
+			pongEnd = getNanos();
+			pongLag += pongEnd - pongStart;
 			pongStart = pongEnd;
+			if (pongLag > MAX_PONG_LAG_US * 1000ULL) {
+				pongLag = MAX_PONG_LAG_US * 1000ULL;
+			}
 
 			// Control paddles
+			int8_t paddle1Direction = 0;
+			int8_t paddle2Direction = 0;
 			if (keyWasPressed['Q']) {
-				paddle1.y -= PADDLE_SPEED * frameTime;
+				paddle1Direction = -1;
 			}
 			else if (keyWasPressed['A']) {
-				paddle1.y += PADDLE_SPEED * frameTime;
+				paddle1Direction = 1;
 			}
 			if (keyWasPressed['O']) {
-				paddle2.y -= PADDLE_SPEED * frameTime;
+				paddle2Direction = -1;
 			}
 			else if (keyWasPressed['L']) {
-				paddle2.y += PADDLE_SPEED * frameTime;
+				paddle2Direction = 1;
 			}
 
-			// Paddle bounds
-			if (paddle1.y < 0) {
-				paddle1.y = 0;
-			}
-			else if (paddle1.y > FULL_LED_ROWS - PADDLE_HEIGHT) {
-				paddle1.y = FULL_LED_ROWS - PADDLE_HEIGHT;
-			}
-			if (paddle2.y < 0) {
-				paddle2.y = 0;
-			}
-			else if (paddle2.y > FULL_LED_ROWS - PADDLE_HEIGHT) {
-				paddle2.y = FULL_LED_ROWS - PADDLE_HEIGHT;
+			// Physics runs in fixed steps, so collisions don't depend on the loop's timing
+			while (pongLag >= PONG_TICK_US * 1000ULL) {
+				if (stepPong(&paddle1, &paddle2, &ball, paddle1Direction, paddle2Direction, PONG_TICK_US)) {
+					publishPongScore(&fpgaMailbox, paddle1.score, paddle2.score);
+				}
+				pongLag -= PONG_TICK_US * 1000ULL;
 			}
 
-			// Ball + wall collisions
-			if (ball.y < 0) {
-				ball.y = 0;
-				ball.vy *= -1;
-			}
-			else if (ball.y > FULL_LED_ROWS - BALL_HEIGHT) {
-				ball.y = FULL_LED_ROWS - BALL_HEIGHT;
-				ball.vy *= -1;
+			// Only send positions that moved by at least one LED
+			uint8_t pongData[4];
+			quantizePong(&paddle1, &paddle2, &ball, pongData);
+			uint8_t pongDataIsChanged = !publishedPongDataIsValid;
+			for (uint8_t i = 0; i < 4; ++i) {
+				if (pongData[i] != publishedPongData[i]) {
+					pongDataIsChanged = 1;
+				}
+				publishedPongData[i] = pongData[i];
 			}
-
-			// Ball + left paddle collisions
-			if (ball.x < PADDLE_WIDTH && ball.y > paddle1.y - BALL_HEIGHT && ball.y < paddle1.y + PADDLE_HEIGHT) {
-				double theta = ((paddle1.y + PADDLE_HEIGHT / 2.0) - (ball.y + BALL_HEIGHT / 2.0)) / (PADDLE_HEIGHT / 2.0) * MAX_BALL_ANGLE;
-				ball.vx = BALL_SPEED * cos(theta);
-				ball.vy = BALL_SPEED * -sin(theta);
+			if (pongDataIsChanged) {
+				publishPongData(&fpgaMailbox, pongData);
+				publishedPongDataIsValid = 1;
 			}
 
-			// Ball + right paddle collisions
-			else if (ball.x > LED_COLS - PADDLE_WIDTH - BALL_WIDTH && ball.y > paddle2.y - BALL_HEIGHT && ball.y < paddle2.y + PADDLE_HEIGHT) {
-				double theta = ((paddle2.y + PADDLE_HEIGHT / 2.0) - (ball.y + BALL_HEIGHT / 2.0)) / (PADDLE_HEIGHT / 2.0) * MAX_BALL_ANGLE;
-				ball.vx = -BALL_SPEED * cos(theta);
-				ball.vy = BALL_SPEED * -sin(theta);
-			}
+			break;
+		}
+		recordValue(&renderTimes, getNanos() - renderStartTime);
+		++framesRendered;
 
-			uint8_t scoreWasUpdated = 0;
+		if (now - lastRecordFlushTime >= RECORD_FLUSH_PERIOD_MS * 1000000ULL) {
+			flushRecorder(&recorder);
+			lastRecordFlushTime = now;
+		}
 
-			// Ball past left paddle
-			if (ball.x < 0) {
-				paddle2.score += 4;
-				resetPong(&paddle1, &paddle2, &ball, 0);
-				scoreWasUpdated = 1;
+		if (metrics) {
+			struct MetricsValues values;
+			values.numFpgaOutputs = fpgaMailbox.numOutputs;
+			values.fpgaBaudRate = 0;
+			values.framesWritten = 0;
+			values.fpgaBytesWritten = 0;
+			values.fpgaWriteTimeouts = 0;
+			values.fpgaWriteErrors = 0;
+			values.pixelTilesWritten = 0;
+			values.fpgaSerialWrites = 0;
+			values.fpgaPacketsDropped = 0;
+			values.fpgaLinkErrors = 0;
+			values.fpgaCreditStalls = 0;
+			values.numFramedFpgaOutputs = 0;
+			values.outputLatencyMicros = 0;
+			values.pipelineLatencyMicros = 0;
+			for (uint8_t i = 0; i < MAX_FPGA_OUTPUTS; ++i) {
+				values.fpgaOutputBytesWritten[i] = 0;
+				if (i >= fpgaMailbox.numOutputs) {
+					continue;
+				}
+				struct FpgaOutput* output = &fpgaMailbox.outputs[i];
+				uint32_t baudRate = (uint32_t) atomicLoad(&output->baudRate);
+				uint32_t outputFramesWritten = (uint32_t) atomicLoad(&output->framesWritten);
+				uint32_t outputLatency = (uint32_t) atomicLoad(&output->outputLatencyMicros);
+				uint32_t pipelineLatency = (uint32_t) atomicLoad(&output->pipelineLatencyMicros);
+				if (i == 0 || baudRate < values.fpgaBaudRate) {
+					values.fpgaBaudRate = baudRate;
+				}
+				if (i == 0 || outputFramesWritten < values.framesWritten) {
+					values.framesWritten = outputFramesWritten;
+				}
+				if (outputLatency > values.outputLatencyMicros) {
+					values.outputLatencyMicros = outputLatency;
+				}
+				if (pipelineLatency > values.pipelineLatencyMicros) {
+					values.pipelineLatencyMicros = pipelineLatency;
+				}
+				values.fpgaOutputBytesWritten[i] = (uint32_t) atomicLoad(&output->bytesWritten);
+				values.fpgaBytesWritten += values.fpgaOutputBytesWritten[i];
+				values.fpgaWriteTimeouts += (uint32_t) atomicLoad(&output->writeTimeouts);
+				values.fpgaWriteErrors += (uint32_t) atomicLoad(&output->writeErrors);
+				values.pixelTilesWritten += (uint32_t) atomicLoad(&output->pixelTilesWritten);
+				values.fpgaSerialWrites += (uint32_t) atomicLoad(&output->serialWrites);
+				values.fpgaPacketsDropped += (uint32_t) atomicLoad(&output->packetsDropped);
+				values.fpgaLinkErrors += (uint32_t) atomicLoad(&output->linkErrors);
+				values.fpgaCreditStalls += (uint32_t) atomicLoad(&output->creditStalls);
+				values.numFramedFpgaOutputs += (uint32_t) atomicLoad(&output->isFramed);
 			}
-
-			// Ball past right paddle
-			else if (ball.x > LED_COLS - BALL_WIDTH) {
-				paddle1.score += 4;
-				resetPong(&paddle1, &paddle2, &ball, 1);
-				scoreWasUpdated = 1;
+			values.renderThreads = renderPool.numThreads;
+			values.renderTilesStolen = (uint32_t) atomicLoad(&renderPool.tilesStolen);
+
+			uint32_t framesWritten = values.framesWritten;
+			unsigned long long fpsPeriod = now - fpsPeriodStartTime;
+			if (fpsPeriod >= METRICS_FPS_PERIOD_MS * 1000000ULL) {
+				renderMilliFps = (uint32_t) ((framesRendered - fpsPeriodStartFramesRendered) * 1000000000000ULL / fpsPeriod);
+				writeMilliFps = (uint32_t) ((framesWritten - fpsPeriodStartFramesWritten) * 1000000000000ULL / fpsPeriod);
+				fpsPeriodStartTime = now;
+				fpsPeriodStartFramesRendered = framesRendered;
+				fpsPeriodStartFramesWritten = framesWritten;
 			}
 
-			if (scoreWasUpdated) {
-				if (paddle1.score > 36 || paddle2.score > 36) {
-					resetPongAndScore(&paddle1, &paddle2, &ball);
-				}
-				setPongScore(fpgaSerial, paddle1.score, paddle2.score);
+			values.updateTimeNanos = now;
+			values.animationMode = animationMode;
+			values.colorMode = colorMode;
+			values.framesRendered = framesRendered;
+			values.framesPublished = (uint32_t) fpgaMailbox.framesPublished;
+			values.framesDropped = (uint32_t) fpgaMailbox.framesDropped;
+			values.arduinoBytesRead = (uint32_t) atomicLoad(&audioRing.writeCount);
+			values.audioSamplesConsumed = (uint32_t) audioRing.samplesConsumed;
+			values.audioSamplesDiscarded = (uint32_t) audioRing.samplesDiscarded;
+			values.renderMilliFps = renderMilliFps;
+			values.writeMilliFps = writeMilliFps;
+			values.frameCacheHits = frameCache.hits;
+			values.frameCacheMisses = frameCache.misses;
+			values.beatsDetected = beatsDetected;
+			for (uint8_t i = 0; i < NUM_AUDIO_BANDS; ++i) {
+				values.audioBandLevels[i] = audioBandLevels[i];
 			}
-
-			// Move ball
-			ball.x += ball.vx * frameTime;
-			ball.y += ball.vy * frameTime;
-
-			setPongData(fpgaSerial, &paddle1, &paddle2, &ball);
-
-			Sleep(1);
-
-			break;
+			publishMetrics(metrics, &values);
 		}
+
+		// Audio input no longer blocks, so yield instead of spinning
+		// Only paces the loop, pong physics and animations are driven by measured time
+		sleepMillis(1);
 	}
 
-	CloseHandle(fpgaSerial);
-	CloseHandle(arduinoSerial);
+	stopSerialWriters(&fpgaMailbox);
+	stopAudioReader(&audioRing);
+	stopInputThread(&inputQueue);
+	closeRecorder(&recorder);
+	stopRenderPool(&renderPool);
+	destroyWavePool(&wavePool);
+	closeSharedMemory(&metricsMemory);
 
 	return 0;
 }
@@ -0,0 +1,37 @@
+#include "metrics.h"
+
+struct MetricsSegment* createMetrics(struct SharedMemory* memory) {
+	openSharedMemory(memory, METRICS_NAME, sizeof(struct MetricsSegment), 0);
+	struct MetricsSegment* segment = (struct MetricsSegment*) memory->data;
+	if (segment) {
+		segment->magic = METRICS_MAGIC;
+		segment->version = METRICS_VERSION;
+		atomicStore(&segment->sequence, 0);
+	}
+	return segment;
+}
+
+void publishMetrics(struct MetricsSegment* segment, struct MetricsValues* values) {
+	atomicIncrement(&segment->sequence);
+	segment->values = *values;
+	atomicIncrement(&segment->sequence);
+}
+
+struct MetricsSegment* openMetrics(struct SharedMemory* memory) {
+	openSharedMemory(memory, METRICS_NAME, sizeof(struct MetricsSegment), 1);
+	struct MetricsSegment* segment = (struct MetricsSegment*) memory->data;
+	if (segment && (segment->magic != METRICS_MAGIC || segment->version != METRICS_VERSION)) {
+		closeSharedMemory(memory);
+		return NULL;
+	}
+	return segment;
+}
+
+void readMetrics(struct MetricsSegment* segment, struct MetricsValues* values) {
+	AtomicInt sequence;
+	do {
+		sequence = atomicLoad(&segment->sequence);
+		*values = segment->values;
+		memoryFence();
+	} while ((sequence & 1) || atomicLoad(&segment->sequence) != sequence);
+}
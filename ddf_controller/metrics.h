@@ -0,0 +1,73 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+
+#include "beat.h"
+#include "platform.h"
+#include "serial.h"
+
+// Live counters and gauges in a named shared memory segment, for tools outside the controller
+// Only the render loop writes the segment, readers copy it under a sequence lock and never block the writer
+#ifdef _WIN32
+#define METRICS_NAME "Local\\ddf_controller_metrics"
+#else
+#define METRICS_NAME "/ddf_controller_metrics"
+#endif
+#define METRICS_MAGIC 0x4D464444  // "DDFM"
+#define METRICS_VERSION 9
+
+// Counters wrap at 2^32, readers should work with differences
+struct MetricsValues {
+	uint64_t updateTimeNanos;  // getNanos() at the last update
+	uint32_t animationMode;  // enum AnimationMode
+	uint32_t colorMode;  // enum ColorMode
+	uint32_t fpgaBaudRate;  // Slowest output
+	uint32_t framesRendered;
+	uint32_t framesPublished;
+	uint32_t framesDropped;  // Replaced before the writer threads picked them up
+	uint32_t framesWritten;  // By every output
+	uint32_t fpgaBytesWritten;  // All outputs
+	uint32_t fpgaWriteTimeouts;  // Writes that returned before all bytes went out
+	uint32_t fpgaWriteErrors;
+	uint32_t arduinoBytesRead;
+	uint32_t audioSamplesConsumed;
+	uint32_t audioSamplesDiscarded;
+	uint32_t renderMilliFps;  // Frames per second * 1000 over the last METRICS_FPS_PERIOD_MS
+	uint32_t writeMilliFps;
+	uint32_t frameCacheHits;
+	uint32_t frameCacheMisses;
+	uint32_t beatsDetected;  // PCM input only
+	uint32_t audioBandLevels[NUM_AUDIO_BANDS];  // 0-255, PCM input only
+	uint32_t outputLatencyMicros;  // Smoothed frame publish to last byte on the wire, slowest output
+	uint32_t pipelineLatencyMicros;  // Smoothed audio sample read to last byte on the wire, slowest output
+	uint32_t pixelTilesWritten;  // Dirty tiles sent in per-pixel modes, all outputs
+	uint32_t renderThreads;
+	uint32_t renderTilesStolen;  // Tiles rendered by a thread other than the one they were assigned to
+	uint32_t numFpgaOutputs;
+	uint32_t fpgaOutputBytesWritten[MAX_FPGA_OUTPUTS];
+	uint32_t fpgaSerialWrites;  // Write calls, all outputs, at most one per frame plus latches
+	uint32_t fpgaPacketsDropped;  // Droppable packets replaced or skipped, all outputs
+	uint32_t numFramedFpgaOutputs;  // Outputs whose FPGA answered with a framed link
+	uint32_t fpgaLinkErrors;  // Frames the FPGAs dropped for a bad CRC or a sequence gap or never answered, and ticks dropped with a link down, all outputs
+	uint32_t fpgaCreditStalls;  // Frames that waited for FPGA buffer space, all outputs
+};
+
+#define METRICS_FPS_PERIOD_MS 1000
+
+struct MetricsSegment {
+	uint32_t magic;
+	uint32_t version;
+	volatile AtomicInt sequence;  // Odd while an update is in progress
+	struct MetricsValues values;
+};
+
+// Returns NULL if the segment could not be created, metrics are then skipped
+struct MetricsSegment* createMetrics(struct SharedMemory* memory);
+void publishMetrics(struct MetricsSegment* segment, struct MetricsValues* values);
+
+// Returns NULL if no controller is running or the layout doesn't match
+struct MetricsSegment* openMetrics(struct SharedMemory* memory);
+void readMetrics(struct MetricsSegment* segment, struct MetricsValues* values);
+
+#endif
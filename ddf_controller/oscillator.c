@@ -0,0 +1,25 @@
+#include <math.h>
+
+#include "oscillator.h"
+
+int16_t sineTable[SINE_TABLE_SIZE];
+
+void initSineTable() {
+	// Precompute sin for better performance
+	for (uint16_t i = 0; i < SINE_TABLE_SIZE; ++i) {
+		sineTable[i] = (int16_t) (32767 * sin((double) i / SINE_TABLE_SIZE * 2 * 3.14159265358979));
+	}
+}
+
+void initOscillator(struct Oscillator* oscillator, double periodMs) {
+	oscillator->phase = 0;
+	oscillator->phaseIncrement = PHASE_STEP(periodMs);
+}
+
+void resetOscillator(struct Oscillator* oscillator) {
+	oscillator->phase = 0;
+}
+
+void advanceOscillator(struct Oscillator* oscillator, uint32_t elapsedMs) {
+	oscillator->phase += oscillator->phaseIncrement * elapsedMs;
+}
@@ -0,0 +1,57 @@
+#ifndef OSCILLATOR_H
+#define OSCILLATOR_H
+
+#include <stdint.h>
+
+// Fixed-point oscillators
+// A phase is a uint32_t where 2^32 is one full period, so wrapping is free
+// Samples come from a Q15 sine table indexed by the top SINE_TABLE_BITS of the phase
+
+#ifdef _MSC_VER
+#define INLINE __inline
+#else
+#define INLINE inline
+#endif
+
+#define SINE_TABLE_BITS 10
+#define SINE_TABLE_SIZE (1 << SINE_TABLE_BITS)
+
+#define PHASE_QUARTER 0x40000000u
+#define PHASE_HALF 0x80000000u
+#define PHASE_THIRD 0x55555555u
+
+// Phase step that completes one period in the given number of units
+#define PHASE_STEP(units) ((uint32_t) (4294967296.0 / (units)))
+
+struct Oscillator {
+	uint32_t phase;
+	uint32_t phaseIncrement;  // Per millisecond
+};
+
+extern int16_t sineTable[SINE_TABLE_SIZE];
+
+void initSineTable();
+
+void initOscillator(struct Oscillator* oscillator, double periodMs);
+void resetOscillator(struct Oscillator* oscillator);
+void advanceOscillator(struct Oscillator* oscillator, uint32_t elapsedMs);
+
+// sin(phase) in Q15
+static INLINE int16_t getSine(uint32_t phase) {
+	return sineTable[phase >> (32 - SINE_TABLE_BITS)];
+}
+
+static INLINE int16_t getCosine(uint32_t phase) {
+	return getSine(phase + PHASE_QUARTER);
+}
+
+// offset + amplitude * sin(phase), amplitude must stay below 2^16
+static INLINE int32_t getScaledSine(uint32_t phase, int32_t amplitude, int32_t offset) {
+	return offset + ((amplitude * getSine(phase)) >> 15);
+}
+
+static INLINE int32_t getScaledCosine(uint32_t phase, int32_t amplitude, int32_t offset) {
+	return getScaledSine(phase + PHASE_QUARTER, amplitude, offset);
+}
+
+#endif
@@ -0,0 +1,140 @@
+#include <string.h>
+
+#include "pcm.h"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#define PCM_READ_CHUNK_FRAMES 256
+
+uint16_t readLe16(const uint8_t* bytes) {
+	return (uint16_t) (bytes[0] | bytes[1] << 8);
+}
+
+uint32_t readLe32(const uint8_t* bytes) {
+	return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+}
+
+// Read the chunks up to the start of "data", the stream is left at the first sample
+uint8_t readWavHeader(struct PcmSource* source) {
+	uint8_t header[8];
+	if (fread(header, 1, 8, source->file) != 8 || memcmp(header + 4, "WAVE", 4) != 0) {
+		return 0;
+	}
+
+	uint8_t hasFormat = 0;
+	while (fread(header, 1, 8, source->file) == 8) {
+		uint32_t chunkSize = readLe32(header + 4);
+		if (memcmp(header, "data", 4) == 0) {
+			return hasFormat;
+		}
+
+		if (memcmp(header, "fmt ", 4) == 0 && chunkSize >= 16 && chunkSize <= 64) {
+			uint8_t format[64];
+			if (fread(format, 1, chunkSize, source->file) != chunkSize) {
+				return 0;
+			}
+			uint16_t formatTag = readLe16(format);
+			uint16_t bitsPerSample = readLe16(format + 14);
+			if ((formatTag != 1 && formatTag != 0xFFFE) || bitsPerSample != 16) {
+				printf("ERROR: Only 16-bit integer WAV input is supported\n");
+				return 0;
+			}
+			source->numChannels = readLe16(format + 2);
+			source->sampleRate = readLe32(format + 4);
+			hasFormat = 1;
+		}
+		else {
+			// Skip chunks a pipe can't seek past
+			for (uint32_t i = 0; i < chunkSize + (chunkSize & 1); ++i) {
+				if (fgetc(source->file) == EOF) {
+					return 0;
+				}
+			}
+			continue;
+		}
+		if (chunkSize & 1) {
+			fgetc(source->file);  // Chunks are padded to even sizes
+		}
+	}
+	return 0;
+}
+
+uint8_t openPcmSource(struct PcmSource* source, const char* path) {
+	source->isStdin = strcmp(path, "-") == 0;
+	if (source->isStdin) {
+#ifdef _WIN32
+		_setmode(_fileno(stdin), _O_BINARY);
+#endif
+		source->file = stdin;
+	}
+	else {
+		source->file = fopen(path, "rb");
+		if (!source->file) {
+			return 0;
+		}
+	}
+	source->sampleRate = PCM_DEFAULT_SAMPLE_RATE;
+	source->numChannels = PCM_DEFAULT_CHANNELS;
+	source->numPending = 0;
+
+	uint8_t magic[4];
+	size_t numRead = fread(magic, 1, 4, source->file);
+	if (numRead == 4 && memcmp(magic, "RIFF", 4) == 0) {
+		if (!readWavHeader(source) || source->numChannels == 0 || source->numChannels > PCM_MAX_CHANNELS || source->sampleRate == 0) {
+			closePcmSource(source);
+			return 0;
+		}
+	}
+	else {
+		memcpy(source->pending, magic, numRead);
+		source->numPending = (uint8_t) numRead;
+	}
+	return 1;
+}
+
+void closePcmSource(struct PcmSource* source) {
+	if (source->file && !source->isStdin) {
+		fclose(source->file);
+	}
+	source->file = NULL;
+}
+
+uint32_t readPcm(struct PcmSource* source, float* samples, uint32_t numFrames) {
+	uint8_t buffer[PCM_READ_CHUNK_FRAMES * PCM_MAX_CHANNELS * 2];
+	uint32_t frameSize = 2 * source->numChannels;
+	float scale = 1.0f / (32768.0f * source->numChannels);
+
+	uint32_t numFramesRead = 0;
+	while (numFramesRead < numFrames) {
+		uint32_t chunkFrames = numFrames - numFramesRead;
+		if (chunkFrames > PCM_READ_CHUNK_FRAMES) {
+			chunkFrames = PCM_READ_CHUNK_FRAMES;
+		}
+
+		uint32_t numBytes = 0;
+		if (source->numPending <= chunkFrames * frameSize) {
+			numBytes = source->numPending;
+			memcpy(buffer, source->pending, numBytes);
+			source->numPending = 0;
+		}
+		numBytes += (uint32_t) fread(buffer + numBytes, 1, chunkFrames * frameSize - numBytes, source->file);
+		uint32_t chunkFramesRead = numBytes / frameSize;
+
+		for (uint32_t i = 0; i < chunkFramesRead; ++i) {
+			int32_t sum = 0;
+			for (uint16_t channel = 0; channel < source->numChannels; ++channel) {
+				sum += (int16_t) readLe16(buffer + i * frameSize + 2 * channel);
+			}
+			samples[numFramesRead + i] = sum * scale;
+		}
+		numFramesRead += chunkFramesRead;
+
+		if (chunkFramesRead < chunkFrames) {
+			break;  // End of input, a partial frame is dropped
+		}
+	}
+	return numFramesRead;
+}
@@ -0,0 +1,31 @@
+#ifndef PCM_H
+#define PCM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Raw PCM input from a WAV file, stdin or a FIFO
+// WAV input must be 16-bit integer PCM, anything without a RIFF header is read as 16-bit little-endian
+// PCM_DEFAULT_SAMPLE_RATE Hz with PCM_DEFAULT_CHANNELS channels (what `arecord -f cd` produces)
+#define PCM_DEFAULT_SAMPLE_RATE 44100
+#define PCM_DEFAULT_CHANNELS 2
+#define PCM_MAX_CHANNELS 8
+
+struct PcmSource {
+	FILE* file;
+	uint32_t sampleRate;
+	uint16_t numChannels;
+	uint8_t isStdin;
+	uint8_t pending[4];  // Start of a raw stream, read while looking for a RIFF header
+	uint8_t numPending;
+};
+
+// "-" reads stdin, returns 0 if the input can't be opened or is an unsupported WAV
+uint8_t openPcmSource(struct PcmSource* source, const char* path);
+void closePcmSource(struct PcmSource* source);
+
+// Read up to numFrames frames downmixed to mono in [-1, 1], blocking until they arrive
+// Returns the number of frames read, less than numFrames only at the end of the input
+uint32_t readPcm(struct PcmSource* source, float* samples, uint32_t numFrames);
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <stdint.h>
+
+// Threads, locks, atomics, time and keyboard input for the Windows and POSIX builds
+
+#ifdef _WIN32
+#include <windows.h>
+
+typedef HANDLE Thread;
+typedef CRITICAL_SECTION Mutex;
+typedef CONDITION_VARIABLE Condition;
+typedef LONG AtomicInt;
+typedef DWORD (WINAPI *ThreadFunc)(LPVOID);
+#define THREAD_FUNC(name) DWORD WINAPI name(LPVOID param)
+#define CACHE_ALIGNED __declspec(align(64))
+#else
+#include <pthread.h>
+
+typedef pthread_t Thread;
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t Condition;
+typedef int32_t AtomicInt;
+typedef void* (*ThreadFunc)(void*);
+#define THREAD_FUNC(name) void* name(void* param)
+#define CACHE_ALIGNED __attribute__((aligned(64)))
+#endif
+
+// Keeps data written by different threads on separate cache lines, CACHE_ALIGNED goes between struct and the name
+#define CACHE_LINE_SIZE 64
+
+void startThread(Thread* thread, ThreadFunc func, void* param);
+void joinThread(Thread* thread);
+uint32_t getProcessorCount();
+
+void initMutex(Mutex* mutex);
+void destroyMutex(Mutex* mutex);
+void lockMutex(Mutex* mutex);
+void unlockMutex(Mutex* mutex);
+
+void initCondition(Condition* condition);
+void waitCondition(Condition* condition, Mutex* mutex);
+void signalCondition(Condition* condition);
+void broadcastCondition(Condition* condition);
+
+// Loads acquire and stores release, so data written before a store is visible after the matching load
+AtomicInt atomicLoad(volatile AtomicInt* value);
+void atomicStore(volatile AtomicInt* value, AtomicInt newValue);
+AtomicInt atomicExchange(volatile AtomicInt* value, AtomicInt newValue);
+AtomicInt atomicIncrement(volatile AtomicInt* value);
+AtomicInt atomicAdd(volatile AtomicInt* value, AtomicInt amount);  // Returns the new value
+void memoryFence();
+
+// Named memory segment other processes can map
+struct SharedMemory {
+	void* data;  // NULL if the segment could not be opened
+	uint32_t size;
+#ifdef _WIN32
+	HANDLE mapping;
+#else
+	const char* name;
+	uint8_t isOwner;
+#endif
+};
+
+// Create and zero the segment, or map an existing one read-only
+void openSharedMemory(struct SharedMemory* memory, const char* name, uint32_t size, uint8_t isReadOnly);
+void closeSharedMemory(struct SharedMemory* memory);  // The creator also removes the name
+
+void sleepMillis(uint32_t ms);
+
+// Monotonic nanoseconds since an arbitrary start, unaffected by system clock changes
+unsigned long long getNanos();
+
+// Keys use Windows virtual-key codes ('A'-'Z', '0'-'9', 37-40 for arrows, 17 for Ctrl)
+void waitForKeyboard(uint32_t timeoutMs);  // Until keyboard state may have changed, or timeoutMs
+void pollKeyboard();
+uint8_t isKeyPressed(uint8_t key);
+
+#endif
@@ -0,0 +1,226 @@
+#include "platform.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <poll.h>
+#include <sys/mman.h>
+
+// A terminal only reports key presses, so a key counts as held for a while after each byte
+// Autorepeat only starts after a delay (typically 250 to 500 ms), so a first byte holds the key for KEY_REPEAT_DELAY_MS
+// and bytes that repeat it for KEY_HOLD_MS, which spans the repeat interval
+// A tap therefore reads as held for KEY_REPEAT_DELAY_MS, and a second tap within that reads as the same press
+#define KEY_REPEAT_DELAY_MS 550
+#define KEY_HOLD_MS 120
+#define NUM_KEY_CODES 128
+
+unsigned long long keyReleaseTimes[NUM_KEY_CODES] = { 0 };
+uint8_t keyboardIsInitialized = 0;
+uint8_t stdinIsClosed = 0;  // Polling a closed stdin would return immediately forever
+struct termios originalTermios;
+
+void startThread(Thread* thread, ThreadFunc func, void* param) {
+	pthread_create(thread, NULL, func, param);
+}
+
+void joinThread(Thread* thread) {
+	pthread_join(*thread, NULL);
+}
+
+uint32_t getProcessorCount() {
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return (count > 0) ? (uint32_t) count : 1;
+}
+
+void initMutex(Mutex* mutex) {
+	pthread_mutex_init(mutex, NULL);
+}
+
+void destroyMutex(Mutex* mutex) {
+	pthread_mutex_destroy(mutex);
+}
+
+void lockMutex(Mutex* mutex) {
+	pthread_mutex_lock(mutex);
+}
+
+void unlockMutex(Mutex* mutex) {
+	pthread_mutex_unlock(mutex);
+}
+
+void initCondition(Condition* condition) {
+	pthread_cond_init(condition, NULL);
+}
+
+void waitCondition(Condition* condition, Mutex* mutex) {
+	pthread_cond_wait(condition, mutex);
+}
+
+void signalCondition(Condition* condition) {
+	pthread_cond_signal(condition);
+}
+
+void broadcastCondition(Condition* condition) {
+	pthread_cond_broadcast(condition);
+}
+
+AtomicInt atomicLoad(volatile AtomicInt* value) {
+	return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+void atomicStore(volatile AtomicInt* value, AtomicInt newValue) {
+	__atomic_store_n(value, newValue, __ATOMIC_RELEASE);
+}
+
+AtomicInt atomicExchange(volatile AtomicInt* value, AtomicInt newValue) {
+	return __atomic_exchange_n(value, newValue, __ATOMIC_SEQ_CST);
+}
+
+AtomicInt atomicIncrement(volatile AtomicInt* value) {
+	return __atomic_add_fetch(value, 1, __ATOMIC_SEQ_CST);
+}
+
+AtomicInt atomicAdd(volatile AtomicInt* value, AtomicInt amount) {
+	return __atomic_add_fetch(value, amount, __ATOMIC_SEQ_CST);
+}
+
+void memoryFence() {
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void openSharedMemory(struct SharedMemory* memory, const char* name, uint32_t size, uint8_t isReadOnly) {
+	memory->data = NULL;
+	memory->size = size;
+	memory->name = name;
+	memory->isOwner = !isReadOnly;
+
+	int fd = isReadOnly ? shm_open(name, O_RDONLY, 0) : shm_open(name, O_CREAT | O_RDWR, 0644);
+	if (fd < 0) {
+		return;
+	}
+	if (!isReadOnly && ftruncate(fd, size) != 0) {
+		close(fd);
+		return;
+	}
+	void* data = mmap(NULL, size, isReadOnly ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return;
+	}
+	memory->data = data;
+	if (!isReadOnly) {
+		memset(data, 0, size);
+	}
+}
+
+void closeSharedMemory(struct SharedMemory* memory) {
+	if (!memory->data) {
+		return;
+	}
+	munmap(memory->data, memory->size);
+	memory->data = NULL;
+	if (memory->isOwner) {
+		shm_unlink(memory->name);
+	}
+}
+
+void sleepMillis(uint32_t ms) {
+	struct timespec duration;
+	duration.tv_sec = ms / 1000;
+	duration.tv_nsec = (long) (ms % 1000) * 1000000;
+	nanosleep(&duration, NULL);
+}
+
+unsigned long long getNanos() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void restoreKeyboard() {
+	tcsetattr(STDIN_FILENO, TCSANOW, &originalTermios);
+}
+
+void initKeyboard() {
+	// Raw, non-blocking stdin without echo
+	tcgetattr(STDIN_FILENO, &originalTermios);
+	atexit(restoreKeyboard);
+
+	struct termios raw = originalTermios;
+	raw.c_lflag &= ~(ICANON | ECHO);
+	raw.c_cc[VMIN] = 0;
+	raw.c_cc[VTIME] = 0;
+	tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+	fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+
+	keyboardIsInitialized = 1;
+}
+
+void waitForKeyboard(uint32_t timeoutMs) {
+	if (!keyboardIsInitialized) {
+		initKeyboard();
+	}
+	if (stdinIsClosed) {
+		sleepMillis(timeoutMs);
+		return;
+	}
+	struct pollfd stdinPoll = { STDIN_FILENO, POLLIN, 0 };
+	poll(&stdinPoll, 1, (int) timeoutMs);
+}
+
+void pressKey(uint8_t key, unsigned long long now) {
+	uint8_t isRepeat = now < keyReleaseTimes[key];
+	keyReleaseTimes[key] = now + (isRepeat ? KEY_HOLD_MS : KEY_REPEAT_DELAY_MS) * 1000000ULL;
+}
+
+// Map terminal bytes to Windows virtual-key codes
+void pollKeyboard() {
+	if (!keyboardIsInitialized) {
+		initKeyboard();
+	}
+
+	unsigned long long now = getNanos();
+	uint8_t buffer[64];
+	ssize_t numBytes = read(STDIN_FILENO, buffer, sizeof(buffer));
+	if (numBytes == 0) {
+		stdinIsClosed = 1;
+	}
+	for (ssize_t i = 0; i < numBytes; ++i) {
+		uint8_t c = buffer[i];
+		if (c == 27 && i + 2 < numBytes && buffer[i + 1] == '[') {
+			// Arrow key escape sequence
+			switch (buffer[i + 2]) {
+			case 'A':
+				pressKey(38, now);
+				break;
+			case 'B':
+				pressKey(40, now);
+				break;
+			case 'C':
+				pressKey(39, now);
+				break;
+			case 'D':
+				pressKey(37, now);
+				break;
+			}
+			i += 2;
+		}
+		else if (c >= 'a' && c <= 'z') {
+			pressKey(c - 'a' + 'A', now);
+		}
+		else if ((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+			pressKey(c, now);
+		}
+		else if (c == '\t') {
+			// No standalone Ctrl key in a terminal, Tab toggles input instead
+			pressKey(17, now);
+		}
+	}
+}
+
+uint8_t isKeyPressed(uint8_t key) {
+	return key < NUM_KEY_CODES && getNanos() < keyReleaseTimes[key];
+}
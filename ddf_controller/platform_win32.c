@@ -0,0 +1,138 @@
+#include "platform.h"
+
+void startThread(Thread* thread, ThreadFunc func, void* param) {
+	*thread = CreateThread(NULL, 0, func, param, 0, NULL);
+}
+
+void joinThread(Thread* thread) {
+	WaitForSingleObject(*thread, INFINITE);
+	CloseHandle(*thread);
+}
+
+uint32_t getProcessorCount() {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+}
+
+void initMutex(Mutex* mutex) {
+	InitializeCriticalSection(mutex);
+}
+
+void destroyMutex(Mutex* mutex) {
+	DeleteCriticalSection(mutex);
+}
+
+void lockMutex(Mutex* mutex) {
+	EnterCriticalSection(mutex);
+}
+
+void unlockMutex(Mutex* mutex) {
+	LeaveCriticalSection(mutex);
+}
+
+void initCondition(Condition* condition) {
+	InitializeConditionVariable(condition);
+}
+
+void waitCondition(Condition* condition, Mutex* mutex) {
+	SleepConditionVariableCS(condition, mutex, INFINITE);
+}
+
+void signalCondition(Condition* condition) {
+	WakeConditionVariable(condition);
+}
+
+void broadcastCondition(Condition* condition) {
+	WakeAllConditionVariable(condition);
+}
+
+AtomicInt atomicLoad(volatile AtomicInt* value) {
+	AtomicInt result = *value;
+	MemoryBarrier();
+	return result;
+}
+
+void atomicStore(volatile AtomicInt* value, AtomicInt newValue) {
+	InterlockedExchange(value, newValue);
+}
+
+AtomicInt atomicExchange(volatile AtomicInt* value, AtomicInt newValue) {
+	return InterlockedExchange(value, newValue);
+}
+
+AtomicInt atomicIncrement(volatile AtomicInt* value) {
+	return InterlockedIncrement(value);
+}
+
+AtomicInt atomicAdd(volatile AtomicInt* value, AtomicInt amount) {
+	return InterlockedExchangeAdd(value, amount) + amount;
+}
+
+void memoryFence() {
+	MemoryBarrier();
+}
+
+void openSharedMemory(struct SharedMemory* memory, const char* name, uint32_t size, uint8_t isReadOnly) {
+	memory->data = NULL;
+	memory->size = size;
+	if (isReadOnly) {
+		memory->mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+	}
+	else {
+		memory->mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, size, name);
+	}
+	if (!memory->mapping) {
+		return;
+	}
+	memory->data = MapViewOfFile(memory->mapping, isReadOnly ? FILE_MAP_READ : FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if (!memory->data) {
+		CloseHandle(memory->mapping);
+		return;
+	}
+	if (!isReadOnly) {
+		ZeroMemory(memory->data, size);
+	}
+}
+
+void closeSharedMemory(struct SharedMemory* memory) {
+	// The name goes away with the last handle
+	if (!memory->data) {
+		return;
+	}
+	UnmapViewOfFile(memory->data);
+	CloseHandle(memory->mapping);
+	memory->data = NULL;
+}
+
+void sleepMillis(uint32_t ms) {
+	Sleep(ms);
+}
+
+unsigned long long getNanos() {
+	static LARGE_INTEGER frequency = { 0 };
+	if (!frequency.QuadPart) {
+		QueryPerformanceFrequency(&frequency);
+	}
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+
+	// Split so the multiplication can't overflow
+	unsigned long long seconds = counter.QuadPart / frequency.QuadPart;
+	unsigned long long remainder = counter.QuadPart % frequency.QuadPart;
+	return seconds * 1000000000 + remainder * 1000000000 / frequency.QuadPart;
+}
+
+void waitForKeyboard(uint32_t timeoutMs) {
+	// GetAsyncKeyState has nothing to wait on
+	Sleep(timeoutMs);
+}
+
+void pollKeyboard() {
+	// GetAsyncKeyState is queried directly
+}
+
+// GetKeyState follows the calling thread's message queue, which the input thread doesn't have
+uint8_t isKeyPressed(uint8_t key) {
+	return (GetAsyncKeyState(key) & 0x8000) != 0;
+}
@@ -0,0 +1,97 @@
+#include <math.h>
+
+#include "predict.h"
+
+void initEnvelopePredictor(struct EnvelopePredictor* predictor) {
+	predictor->level = 0;
+	predictor->slopePerNano = 0;
+	predictor->lastTimeNanos = 0;
+}
+
+void updateEnvelope(struct EnvelopePredictor* predictor, double level, unsigned long long timeNanos) {
+	if (predictor->lastTimeNanos && timeNanos > predictor->lastTimeNanos) {
+		double slope = (level - predictor->level) / (double) (timeNanos - predictor->lastTimeNanos);
+		predictor->slopePerNano += ENVELOPE_SLOPE_SMOOTHING * (slope - predictor->slopePerNano);
+	}
+	predictor->level = level;
+	predictor->lastTimeNanos = timeNanos;
+}
+
+double predictEnvelope(struct EnvelopePredictor* predictor, unsigned long long timeNanos) {
+	if (!predictor->lastTimeNanos || timeNanos <= predictor->lastTimeNanos) {
+		return predictor->level;
+	}
+
+	if (fabs(predictor->slopePerNano) * 1e9 < MIN_ENVELOPE_SLOPE_PER_SECOND) {
+		return predictor->level;
+	}
+
+	unsigned long long ahead = timeNanos - predictor->lastTimeNanos;
+	if (ahead > MAX_PREDICTION_MS * 1000000ULL) {
+		ahead = MAX_PREDICTION_MS * 1000000ULL;
+	}
+	double level = predictor->level + predictor->slopePerNano * (double) ahead;
+	if (level < 0) {
+		return 0;
+	}
+	if (level > 1) {
+		return 1;
+	}
+	return level;
+}
+
+void initBeatPredictor(struct BeatPredictor* predictor) {
+	predictor->lastBeatNanos = 0;
+	predictor->intervalNanos = 0;
+	predictor->numSteadyBeats = 0;
+	predictor->isPredictedBeatFired = 0;
+}
+
+uint8_t observeBeat(struct BeatPredictor* predictor, unsigned long long timeNanos) {
+	// A beat close to one already predicted is that beat arriving, not a new one
+	uint8_t wasPredicted = 0;
+	if (predictor->isPredictedBeatFired) {
+		double predictedNanos = predictor->lastBeatNanos + predictor->intervalNanos;
+		double error = timeNanos - predictedNanos;
+		wasPredicted = error > -predictor->intervalNanos / 2 && error < predictor->intervalNanos / 2;
+	}
+	predictor->isPredictedBeatFired = 0;
+
+	unsigned long long interval = predictor->lastBeatNanos ? timeNanos - predictor->lastBeatNanos : 0;
+	if (!interval || interval > MAX_BEAT_INTERVAL_MS * 1000000ULL) {
+		predictor->intervalNanos = 0;
+		predictor->numSteadyBeats = 0;
+	}
+	else if (!predictor->intervalNanos) {
+		predictor->intervalNanos = (double) interval;
+	}
+	else {
+		double error = interval - predictor->intervalNanos;
+		if (error < 0) {
+			error = -error;
+		}
+		if (error < BEAT_TEMPO_TOLERANCE * predictor->intervalNanos) {
+			if (predictor->numSteadyBeats < MIN_STEADY_BEATS) {
+				++predictor->numSteadyBeats;
+			}
+		}
+		else {
+			predictor->numSteadyBeats = 0;
+		}
+		predictor->intervalNanos += BEAT_INTERVAL_SMOOTHING * (interval - predictor->intervalNanos);
+	}
+	predictor->lastBeatNanos = timeNanos;
+
+	return !wasPredicted;
+}
+
+uint8_t isBeatDue(struct BeatPredictor* predictor, unsigned long long timeNanos) {
+	if (predictor->numSteadyBeats < MIN_STEADY_BEATS || predictor->isPredictedBeatFired) {
+		return 0;
+	}
+	if (timeNanos < predictor->lastBeatNanos + (unsigned long long) predictor->intervalNanos) {
+		return 0;
+	}
+	predictor->isPredictedBeatFired = 1;
+	return 1;
+}
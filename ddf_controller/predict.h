@@ -0,0 +1,46 @@
+#ifndef PREDICT_H
+#define PREDICT_H
+
+#include <stdint.h>
+
+// Predictive frame scheduling
+// Frames reach the LEDs some time after the audio that drove them, measured by the writer thread
+// Rendering uses the audio envelope and beats predicted that far ahead, so light lines up with sound
+#define USE_PREDICTIVE_SCHEDULING 1
+#define MAX_PREDICTION_MS 150  // Extrapolating further than this is mostly guessing
+#define ENVELOPE_SLOPE_SMOOTHING 0.2  // Weight of each new slope measurement
+#define MIN_ENVELOPE_SLOPE_PER_SECOND 1.0  // Slower changes are held rather than extrapolated, so steady audio gives a steady level
+
+#define BEAT_INTERVAL_SMOOTHING 0.2  // Weight of each new inter-beat interval
+#define MAX_BEAT_INTERVAL_MS 2000  // Longer gaps restart tempo tracking
+#define BEAT_TEMPO_TOLERANCE 0.15  // Intervals within this fraction of the estimate count as steady
+#define MIN_STEADY_BEATS 2  // Steady intervals needed before beats are predicted
+
+// Linear extrapolation of a smoothed level in [0, 1]
+struct EnvelopePredictor {
+	double level;
+	double slopePerNano;
+	unsigned long long lastTimeNanos;  // 0 until the first level
+};
+
+// Tempo tracking from beat times, predicts the next beat once the tempo is steady
+struct BeatPredictor {
+	unsigned long long lastBeatNanos;  // 0 until the first beat
+	double intervalNanos;  // 0 until the second beat
+	uint8_t numSteadyBeats;
+	uint8_t isPredictedBeatFired;  // The beat after lastBeatNanos was already acted on
+};
+
+void initEnvelopePredictor(struct EnvelopePredictor* predictor);
+void updateEnvelope(struct EnvelopePredictor* predictor, double level, unsigned long long timeNanos);
+double predictEnvelope(struct EnvelopePredictor* predictor, unsigned long long timeNanos);
+
+void initBeatPredictor(struct BeatPredictor* predictor);
+
+// Returns 1 if the beat should be acted on, 0 if it was already predicted
+uint8_t observeBeat(struct BeatPredictor* predictor, unsigned long long timeNanos);
+
+// Returns 1 once per beat when the next predicted beat falls before timeNanos
+uint8_t isBeatDue(struct BeatPredictor* predictor, unsigned long long timeNanos);
+
+#endif
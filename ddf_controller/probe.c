@@ -0,0 +1,114 @@
+#include <stdio.h>
+
+#include "platform.h"
+#include "probe.h"
+#include "protocol.h"
+
+uint16_t getChecksum(const uint8_t* data, uint16_t size) {
+	uint16_t sum1 = 0;
+	uint16_t sum2 = 0;
+	for (uint16_t i = 0; i < size; ++i) {
+		sum1 = (sum1 + data[i]) % 255;
+		sum2 = (sum2 + sum1) % 255;
+	}
+	return (sum2 << 8) | sum1;
+}
+
+uint8_t readProbeReply(SerialPort serial, uint8_t* reply) {
+	uint16_t bytesReceived = 0;
+	while (bytesReceived < PROBE_REPLY_SIZE) {
+		int32_t bytesRead = readSerial(serial, reply + bytesReceived, PROBE_REPLY_SIZE - bytesReceived);
+		if (bytesRead <= 0) {
+			return 0;
+		}
+		bytesReceived += (uint16_t) bytesRead;
+	}
+	return 1;
+}
+
+uint8_t runProbe(SerialPort serial) {
+	uint8_t packet[PROBE_PACKET_SIZE];
+	uint8_t reply[PROBE_REPLY_SIZE];
+	uint32_t state = 0x2545F491;
+
+	flushSerialInput(serial);
+	packet[0] = CMD_BYTE;
+	packet[1] = PROBE_CODE;
+	for (uint8_t i = 0; i < PROBE_ROUNDS; ++i) {
+		// Pseudo-random pattern without CMD_BYTE, so FPGAs without probe support skip it
+		for (uint8_t j = 0; j < PROBE_PATTERN_SIZE; ++j) {
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			packet[j + 2] = (uint8_t) (state % CMD_BYTE);
+		}
+		if (writeSerial(serial, packet, PROBE_PACKET_SIZE) != PROBE_PACKET_SIZE || !readProbeReply(serial, reply)) {
+			return 0;
+		}
+
+		uint16_t checksum = getChecksum(packet + 2, PROBE_PATTERN_SIZE);
+		if (reply[0] != CMD_BYTE || reply[1] != PROBE_CODE || reply[2] != (checksum >> 8) || reply[3] != (checksum & 0xFF)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+uint8_t switchBaudRate(SerialPort serial, uint32_t baudRate) {
+	uint8_t packet[SET_BAUD_RATE_PACKET_SIZE];
+	packet[0] = CMD_BYTE;
+	packet[1] = SET_BAUD_RATE_CODE;
+	packet[2] = (uint8_t) ((baudRate / 100) >> 8);
+	packet[3] = (uint8_t) ((baudRate / 100) & 0xFF);
+	if (writeSerial(serial, packet, SET_BAUD_RATE_PACKET_SIZE) != SET_BAUD_RATE_PACKET_SIZE) {
+		return 0;
+	}
+	uint8_t isSwitched = setSerialBaudRate(serial, baudRate);
+	sleepMillis(BAUD_RATE_SWITCH_MS);
+	return isSwitched;
+}
+
+// Wait for the FPGA to give up on a failed rate and meet it back at its power-on rate
+void fallBackBaudRate(SerialPort serial) {
+	sleepMillis(2 * BAUD_RATE_FALLBACK_MS);
+	setSerialBaudRate(serial, SERIAL_BAUD_RATE);
+}
+
+uint32_t probeBaudRate(SerialPort serial, uint32_t lastBaudRate, uint8_t* isAnswered) {
+	const uint32_t baudRates[NUM_PROBE_BAUD_RATES] = PROBE_BAUD_RATES;
+	uint32_t baudRate = SERIAL_BAUD_RATE;
+
+	// An FPGA that was not reset is still at the rate it was probed at
+	if (lastBaudRate != SERIAL_BAUD_RATE && setSerialBaudRate(serial, lastBaudRate)) {
+		if (runProbe(serial)) {
+			*isAnswered = 1;
+			printf("FPGA link still running at %u baud\n", lastBaudRate);
+			return lastBaudRate;
+		}
+		setSerialBaudRate(serial, SERIAL_BAUD_RATE);
+	}
+
+	*isAnswered = runProbe(serial);
+	if (!*isAnswered) {
+		printf("FPGA did not answer the baud rate probe, staying at %u baud\n", baudRate);
+		return baudRate;
+	}
+
+	for (uint8_t i = 0; i < NUM_PROBE_BAUD_RATES; ++i) {
+		if (switchBaudRate(serial, baudRates[i]) && runProbe(serial)) {
+			baudRate = baudRates[i];
+			continue;
+		}
+
+		// Go back to the fastest rate that worked
+		fallBackBaudRate(serial);
+		if (baudRate != SERIAL_BAUD_RATE && !(switchBaudRate(serial, baudRate) && runProbe(serial))) {
+			fallBackBaudRate(serial);
+			baudRate = SERIAL_BAUD_RATE;
+		}
+		break;
+	}
+
+	printf("FPGA link running at %u baud\n", baudRate);
+	return baudRate;
+}
@@ -0,0 +1,26 @@
+#ifndef PROBE_H
+#define PROBE_H
+
+#include <stdint.h>
+
+#include "serial.h"
+
+// FPGA link speed probing
+// Rates are tried in increasing order, the link stays at the fastest one that passes every probe round
+#define PROBE_BAUD_RATES { 230400, 460800, 921600, 2000000 }
+#define NUM_PROBE_BAUD_RATES 4
+#define PROBE_ROUNDS 8
+#define BAUD_RATE_SWITCH_MS 10  // Time for the FPGA to switch rates after SET_BAUD_RATE_CODE
+
+uint16_t getChecksum(const uint8_t* data, uint16_t size);  // Fletcher-16
+
+// Send PROBE_ROUNDS test patterns and check every reply, returns 0 on any error
+uint8_t runProbe(SerialPort serial);
+
+// Start from SERIAL_BAUD_RATE and step up through PROBE_BAUD_RATES, returns the rate the link is left at
+// FPGAs without probe support never answer and stay at SERIAL_BAUD_RATE
+// On a reconnect lastBaudRate is the rate the link was left at, and is kept if the FPGA still answers there
+// isAnswered is set if the FPGA answered any probe
+uint32_t probeBaudRate(SerialPort serial, uint32_t lastBaudRate, uint8_t* isAnswered);
+
+#endif
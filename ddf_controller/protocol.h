@@ -0,0 +1,103 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+// Serial protocol shared by the controller and the FPGA
+// Every packet starts with CMD_BYTE followed by a command code
+// Commands were added in order, so firmware that answers PROBE_CODE takes every command up to it,
+// and firmware that answers GET_LINK_STATUS_CODE takes every command here
+// Row output falls back to SET_ROWS_COLOR_CODE for firmware that answers neither
+
+// LED_ROWS is actually half the real number of rows for performance purposes
+#define LED_ROWS 36
+#define FULL_LED_ROWS 72
+#define LED_COLS 165
+
+#define CMD_BYTE 255
+
+// Serial command codes
+#define SET_ROWS_COLOR_CODE 22  // LED_ROWS * (g, r, b)
+#define SET_PONG_DATA_CODE 23  // Paddle 1 y, paddle 2 y, ball x, ball y
+#define SET_PONG_SCORE_CODE 24  // Score 1, score 2
+#define SET_ROW_RANGE_COLOR_CODE 25  // Start row, row count, count * (g, r, b), requires FPGA firmware support
+
+// Full resolution commands address all FULL_LED_ROWS rows, require FPGA firmware support
+#define SET_FULL_RES_ROWS_CODE 26  // FULL_LED_ROWS * (g, r, b)
+#define SET_FULL_RES_RLE_CODE 27  // Run count, count * (length, g, r, b), lengths add up to FULL_LED_ROWS
+#define SET_FULL_RES_DELTA_CODE 28  // First row (g, r, b), then (FULL_LED_ROWS - 1) * (dg, dr, db) as signed 4-bit deltas from the row above, high nibble first
+#define SET_PALETTE_CODE 29  // Color count, count * (g, r, b), kept by the FPGA for indexed frames
+#define SET_INDEXED_ROWS_4_CODE 30  // FULL_LED_ROWS 4-bit palette indices, high nibble first
+#define SET_INDEXED_ROWS_8_CODE 31  // FULL_LED_ROWS 8-bit palette indices
+
+// Link setup, requires FPGA firmware support
+// After SET_BAUD_RATE_CODE the FPGA returns to its power-on rate unless a valid probe arrives within BAUD_RATE_FALLBACK_MS
+#define SET_BAUD_RATE_CODE 32  // New rate / 100 (high byte, low byte), applied once the packet is received
+#define PROBE_CODE 33  // PROBE_PATTERN_SIZE bytes, answered with CMD_BYTE, PROBE_CODE, Fletcher-16 checksum of the bytes (high byte, low byte)
+
+// Multi-panel sync, requires FPGA firmware support
+// In latch mode row packets only update a back buffer, which is shown when LATCH_FRAME_CODE arrives
+#define SET_LATCH_MODE_CODE 34  // 1 to hold row updates until latched, 0 to show them immediately
+#define LATCH_FRAME_CODE 35  // Frame number (low byte), the same on every panel
+
+// Per-pixel framebuffer, requires FPGA firmware support
+// The panel is split into PIXEL_TILE_WIDTH x PIXEL_TILE_HEIGHT tiles numbered row by row from the top left,
+// the last tile column hangs over the right edge and its pixels past LED_COLS are ignored
+#define SET_PIXEL_TILE_CODE 36  // Tile index, PIXEL_TILE_WIDTH * PIXEL_TILE_HEIGHT * (g, r, b) row by row
+
+// Framed link, requires FPGA firmware support
+// CMD_BYTE alone can't delimit packets since payloads can contain it, so a frame wraps a batch of packets with a
+// length, a sequence number and a CRC, and the FPGA drops damaged frames whole and counts them along with sequence gaps
+// Frames and bare packets can be mixed, the FPGA answers GET_LINK_STATUS_CODE and every frame it finishes with a status packet
+// The credit limit in a status packet is the total of frame bytes the host may have sent since GET_LINK_STATUS_CODE:
+// frame bytes the FPGA has consumed plus its free receive buffer
+// CRCs are CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xFFFF) over everything after the command code
+#define LINK_FRAME_CODE 37  // Version, sequence, payload size (high byte, low byte), payload of packets, CRC (high byte, low byte)
+#define GET_LINK_STATUS_CODE 38  // Version, resets the sequence, credit limit and error count
+#define LINK_STATUS_CODE 39  // FPGA to host: version, last good sequence, credit limit (4 bytes, high byte first), error count, CRC (high byte, low byte)
+
+// Full resolution row ranges, require FPGA firmware support
+#define SET_FULL_RES_RANGE_CODE 40  // Start row, row count, count * (g, r, b), rows out of FULL_LED_ROWS
+
+#define FULL_ROWS_PACKET_SIZE (3 * LED_ROWS + 2)
+#define ROW_RANGE_HEADER_SIZE 4
+#define PONG_DATA_PACKET_SIZE 6
+#define PONG_SCORE_PACKET_SIZE 4
+
+#define FULL_RES_ROWS_PACKET_SIZE (3 * FULL_LED_ROWS + 2)
+#define FULL_RES_RLE_HEADER_SIZE 3
+#define FULL_RES_RLE_RUN_SIZE 4
+#define FULL_RES_DELTA_PACKET_SIZE (5 + (3 * (FULL_LED_ROWS - 1) + 1) / 2)
+#define FULL_RES_DELTA_MIN -8
+#define FULL_RES_DELTA_MAX 7
+
+#define MAX_PALETTE_SIZE 64
+#define MAX_PALETTE_4_SIZE 16  // Largest palette 4-bit indices can address
+#define PALETTE_HEADER_SIZE 3
+#define INDEXED_ROWS_4_PACKET_SIZE (2 + FULL_LED_ROWS / 2)
+#define INDEXED_ROWS_8_PACKET_SIZE (2 + FULL_LED_ROWS)
+
+#define SET_BAUD_RATE_PACKET_SIZE 4
+#define PROBE_PATTERN_SIZE 64
+#define PROBE_PACKET_SIZE (2 + PROBE_PATTERN_SIZE)
+#define PROBE_REPLY_SIZE 4
+#define BAUD_RATE_FALLBACK_MS 250
+
+#define PIXEL_TILE_WIDTH 8
+#define PIXEL_TILE_HEIGHT 8
+#define PIXEL_TILE_COLS ((LED_COLS + PIXEL_TILE_WIDTH - 1) / PIXEL_TILE_WIDTH)
+#define PIXEL_TILE_ROWS (FULL_LED_ROWS / PIXEL_TILE_HEIGHT)
+#define NUM_PIXEL_TILES (PIXEL_TILE_COLS * PIXEL_TILE_ROWS)  // Must fit the 1-byte tile index
+#define PIXEL_TILE_PACKET_SIZE (3 + 3 * PIXEL_TILE_WIDTH * PIXEL_TILE_HEIGHT)
+
+#define SET_LATCH_MODE_PACKET_SIZE 3
+#define LATCH_FRAME_PACKET_SIZE 3
+
+#define LINK_VERSION 1
+#define LINK_FRAME_HEADER_SIZE 6
+#define LINK_FRAME_TRAILER_SIZE 2
+#define LINK_FRAME_OVERHEAD (LINK_FRAME_HEADER_SIZE + LINK_FRAME_TRAILER_SIZE)
+#define MAX_LINK_FRAME_PAYLOAD 65535
+#define GET_LINK_STATUS_PACKET_SIZE 3
+#define LINK_STATUS_PACKET_SIZE 11
+#define LINK_CRC_INIT 0xFFFF
+
+#endif
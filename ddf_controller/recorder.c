@@ -0,0 +1,92 @@
+#include <string.h>
+
+#include "recorder.h"
+
+uint8_t openRecorder(struct Recorder* recorder, const char* path) {
+	recorder->file = NULL;
+	if (!path) {
+		return 1;
+	}
+
+	FILE* file = fopen(path, "wb");
+	if (!file) {
+		return 0;
+	}
+	setvbuf(file, NULL, _IOFBF, RECORD_BUFFER_SIZE);
+
+	uint8_t header[RECORD_FILE_HEADER_SIZE] = { 0 };
+	memcpy(header, RECORD_MAGIC, 4);
+	header[4] = RECORD_VERSION & 0xFF;
+	header[5] = RECORD_VERSION >> 8;
+	fwrite(header, 1, RECORD_FILE_HEADER_SIZE, file);
+
+	initMutex(&recorder->lock);
+	recorder->startTime = getNanos();
+	recorder->file = file;
+	return 1;
+}
+
+void closeRecorder(struct Recorder* recorder) {
+	if (!recorder->file) {
+		return;
+	}
+	fclose(recorder->file);
+	recorder->file = NULL;
+	destroyMutex(&recorder->lock);
+}
+
+void flushRecorder(struct Recorder* recorder) {
+	if (!recorder->file) {
+		return;
+	}
+	lockMutex(&recorder->lock);
+	fflush(recorder->file);
+	unlockMutex(&recorder->lock);
+}
+
+void recordData(struct Recorder* recorder, enum RecordType type, unsigned long long timeNanos, const uint8_t* data, uint16_t size) {
+	if (!recorder || !recorder->file) {
+		return;
+	}
+
+	// Reads can finish just before recording starts
+	unsigned long long time = (timeNanos > recorder->startTime) ? timeNanos - recorder->startTime : 0;
+	uint8_t header[RECORD_HEADER_SIZE];
+	for (uint8_t i = 0; i < 8; ++i) {
+		header[i] = (uint8_t) (time >> (8 * i));
+	}
+	header[8] = size & 0xFF;
+	header[9] = size >> 8;
+	header[10] = (uint8_t) type;
+
+	lockMutex(&recorder->lock);
+	fwrite(header, 1, RECORD_HEADER_SIZE, recorder->file);
+	fwrite(data, 1, size, recorder->file);
+	unlockMutex(&recorder->lock);
+}
+
+uint8_t readRecord(const uint8_t* log, size_t logSize, size_t* offset, struct Record* record) {
+	if (!*offset) {
+		if (logSize < RECORD_FILE_HEADER_SIZE || memcmp(log, RECORD_MAGIC, 4) != 0 || log[4] != RECORD_VERSION || log[5] != 0) {
+			return 0;
+		}
+		*offset = RECORD_FILE_HEADER_SIZE;
+	}
+	if (logSize - *offset < RECORD_HEADER_SIZE) {
+		return 0;
+	}
+
+	const uint8_t* header = log + *offset;
+	record->timeNanos = 0;
+	for (uint8_t i = 0; i < 8; ++i) {
+		record->timeNanos |= (unsigned long long) header[i] << (8 * i);
+	}
+	record->size = (uint16_t) (header[8] | header[9] << 8);
+	record->type = (enum RecordType) header[10];
+	if (logSize - *offset - RECORD_HEADER_SIZE < record->size) {
+		return 0;  // Cut off mid-record, e.g. by a crash
+	}
+	record->data = header + RECORD_HEADER_SIZE;
+	*offset += RECORD_HEADER_SIZE + record->size;
+	return 1;
+}
@@ -0,0 +1,53 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "platform.h"
+
+// Append-only binary log of FPGA and Arduino serial traffic, replayed by ddf_replay
+// The file starts with RECORD_FILE_HEADER_SIZE bytes: magic, then version (2 bytes) and 2 reserved bytes
+// Each record is RECORD_HEADER_SIZE bytes: time in nanoseconds since recording started (8 bytes), payload size (2 bytes), type,
+// followed by the payload
+// Multi-byte fields are little-endian
+#define RECORD_MAGIC "DDFR"
+#define RECORD_VERSION 1
+#define RECORD_FILE_HEADER_SIZE 8
+#define RECORD_HEADER_SIZE 11
+#define RECORD_BUFFER_SIZE (1 << 20)  // stdio buffer, written out when full or on flushRecorder
+
+enum RecordType {
+	RECORD_FPGA_PACKET = 1,  // One packet as handed to the FPGA port
+	RECORD_ARDUINO_BYTES,  // One read from the Arduino port
+	RECORD_FPGA_BAUD_RATE  // 4-byte rate the FPGA link switched to
+};
+
+// Shared by the writer thread and the audio reader thread
+struct Recorder {
+	Mutex lock;
+	FILE* file;  // NULL when not recording
+	unsigned long long startTime;
+};
+
+struct Record {
+	unsigned long long timeNanos;
+	enum RecordType type;
+	uint16_t size;
+	const uint8_t* data;
+};
+
+// A NULL path leaves the recorder off, returns 0 if the file could not be created
+uint8_t openRecorder(struct Recorder* recorder, const char* path);
+void closeRecorder(struct Recorder* recorder);
+void flushRecorder(struct Recorder* recorder);
+
+// timeNanos is from getNanos, a NULL recorder records nothing
+void recordData(struct Recorder* recorder, enum RecordType type, unsigned long long timeNanos, const uint8_t* data, uint16_t size);
+
+// Parse a log in memory, offset starts at 0 and is advanced past each record
+// Returns 0 at the end of the log, or if it is truncated or not a log
+uint8_t readRecord(const uint8_t* log, size_t logSize, size_t* offset, struct Record* record);
+
+#endif
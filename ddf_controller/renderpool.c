@@ -0,0 +1,117 @@
+#include "renderpool.h"
+
+// Render tiles until every range is empty, starting with the worker's own
+void runRenderWorker(struct RenderPool* pool, uint8_t index) {
+	AtomicInt tilesStolen = 0;
+	for (uint8_t i = 0; i < pool->numThreads; ++i) {
+		struct RenderRange* range = &pool->ranges[(index + i) % pool->numThreads];
+		while (1) {
+			AtomicInt tile = atomicIncrement(&range->nextTile) - 1;
+			if (tile >= range->endTile) {
+				break;
+			}
+			pool->render(&pool->framebuffer->tiles[tile], (uint16_t) tile, pool->context);
+			if (i) {
+				++tilesStolen;
+			}
+		}
+	}
+	if (tilesStolen) {
+		atomicAdd(&pool->tilesStolen, tilesStolen);
+	}
+}
+
+THREAD_FUNC(renderWorkerThread) {
+	struct RenderWorker* worker = (struct RenderWorker*) param;
+	struct RenderPool* pool = worker->pool;
+
+	while (1) {
+		lockMutex(&pool->lock);
+		while (pool->isRunning && worker->jobNumber == pool->jobNumber) {
+			waitCondition(&pool->jobReady, &pool->lock);
+		}
+		if (!pool->isRunning) {
+			unlockMutex(&pool->lock);
+			break;
+		}
+		worker->jobNumber = pool->jobNumber;
+		unlockMutex(&pool->lock);
+
+		runRenderWorker(pool, worker->index);
+
+		lockMutex(&pool->lock);
+		if (--pool->numWorkersBusy == 0) {
+			signalCondition(&pool->jobDone);
+		}
+		unlockMutex(&pool->lock);
+	}
+
+	return 0;
+}
+
+void startRenderPool(struct RenderPool* pool, uint32_t numThreads) {
+	if (!numThreads) {
+		numThreads = getProcessorCount();
+	}
+	if (numThreads > MAX_RENDER_THREADS) {
+		numThreads = MAX_RENDER_THREADS;
+	}
+	initMutex(&pool->lock);
+	initCondition(&pool->jobReady);
+	initCondition(&pool->jobDone);
+	pool->numThreads = (uint8_t) numThreads;
+	pool->jobNumber = 0;
+	pool->numWorkersBusy = 0;
+	pool->isRunning = 1;
+	pool->tilesStolen = 0;
+	for (uint8_t i = 0; i < pool->numThreads; ++i) {
+		struct RenderWorker* worker = &pool->workers[i];
+		worker->pool = pool;
+		worker->index = i;
+		worker->jobNumber = 0;
+		if (i) {
+			startThread(&worker->thread, renderWorkerThread, worker);
+		}
+	}
+}
+
+void stopRenderPool(struct RenderPool* pool) {
+	lockMutex(&pool->lock);
+	pool->isRunning = 0;
+	broadcastCondition(&pool->jobReady);
+	unlockMutex(&pool->lock);
+
+	for (uint8_t i = 1; i < pool->numThreads; ++i) {
+		joinThread(&pool->workers[i].thread);
+	}
+	destroyMutex(&pool->lock);
+}
+
+void renderTiles(struct RenderPool* pool, struct Framebuffer* framebuffer, TileRenderFunc render, void* context) {
+	pool->framebuffer = framebuffer;
+	pool->render = render;
+	pool->context = context;
+	for (uint8_t i = 0; i < pool->numThreads; ++i) {
+		pool->ranges[i].nextTile = NUM_PIXEL_TILES * i / pool->numThreads;
+		pool->ranges[i].endTile = NUM_PIXEL_TILES * (i + 1) / pool->numThreads;
+	}
+
+	// The lock publishes the job to the workers
+	if (pool->numThreads > 1) {
+		lockMutex(&pool->lock);
+		++pool->jobNumber;
+		pool->numWorkersBusy = pool->numThreads - 1;
+		broadcastCondition(&pool->jobReady);
+		unlockMutex(&pool->lock);
+	}
+
+	runRenderWorker(pool, 0);
+
+	if (pool->numThreads > 1) {
+		lockMutex(&pool->lock);
+		while (pool->numWorkersBusy) {
+			waitCondition(&pool->jobDone, &pool->lock);
+		}
+		unlockMutex(&pool->lock);
+	}
+}
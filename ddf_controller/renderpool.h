@@ -0,0 +1,60 @@
+#ifndef RENDERPOOL_H
+#define RENDERPOOL_H
+
+#include <stdint.h>
+
+#include "effects.h"
+#include "platform.h"
+
+// Per-pixel rendering spread over a fixed set of threads
+// Each frame the framebuffer's tiles are split into one contiguous range per thread
+// A thread claims tiles from the front of its own range, then steals from the other ranges once its own runs out
+// Claims are a fetch-and-add on the range's next tile, so no lock is taken per tile and nothing is allocated per frame
+#define MAX_RENDER_THREADS 16
+#define RENDER_THREADS 0  // Including the render loop, 0 for one per processor
+
+// Written by whichever threads claim from it, kept on its own cache line
+struct CACHE_ALIGNED RenderRange {
+	volatile AtomicInt nextTile;
+	AtomicInt endTile;
+};
+
+struct RenderPool;
+
+struct RenderWorker {
+	struct RenderPool* pool;
+	uint8_t index;
+	Thread thread;
+	uint32_t jobNumber;  // Last job this worker ran, protected by the pool lock
+};
+
+struct RenderPool {
+	Mutex lock;
+	Condition jobReady;
+	Condition jobDone;
+	uint8_t numThreads;  // Worker 0 is the thread calling renderTiles and has no thread of its own
+	struct RenderWorker workers[MAX_RENDER_THREADS];
+	struct RenderRange ranges[MAX_RENDER_THREADS];
+
+	// Protected by the lock
+	uint32_t jobNumber;
+	uint8_t numWorkersBusy;
+	uint8_t isRunning;
+
+	// Current job, set before jobNumber advances
+	struct Framebuffer* framebuffer;
+	TileRenderFunc render;
+	void* context;
+
+	volatile AtomicInt tilesStolen;  // Tiles rendered by a thread other than the range's owner
+};
+
+// numThreads is capped at MAX_RENDER_THREADS, 0 for one per processor
+void startRenderPool(struct RenderPool* pool, uint32_t numThreads);
+void stopRenderPool(struct RenderPool* pool);
+
+// Render every tile of framebuffer with render, returns once all tiles are done
+// Only one thread may call this at a time
+void renderTiles(struct RenderPool* pool, struct Framebuffer* framebuffer, TileRenderFunc render, void* context);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <stdint.h>
+
+// Serial transport, implemented by serial_win32.c and serial_posix.c
+
+#ifdef _WIN32
+#include <windows.h>
+
+typedef HANDLE SerialPort;
+#define INVALID_SERIAL_PORT INVALID_HANDLE_VALUE
+#define DEFAULT_FPGA_PORT "\\\\.\\COM4"
+#define DEFAULT_ARDUINO_PORT "\\\\.\\COM5"
+#else
+typedef int SerialPort;
+#define INVALID_SERIAL_PORT -1
+#define DEFAULT_FPGA_PORT "/dev/ttyUSB0"
+#define DEFAULT_ARDUINO_PORT "/dev/ttyACM0"
+#endif
+
+#define SERIAL_BAUD_RATE 115200  // Default for both links
+#define MAX_FPGA_OUTPUTS 4  // One panel per FPGA port
+#define SERIAL_TIMEOUT_MS 100
+#define UART_BITS_PER_BYTE 10  // 8N1 framing
+
+// Open port at baudRate, 8N1
+SerialPort connectSerial(const char* port, uint32_t baudRate);
+void closeSerial(SerialPort serial);
+
+// Waits for pending writes to go out first, returns 0 if the rate is not supported
+uint8_t setSerialBaudRate(SerialPort serial, uint32_t baudRate);
+
+// Discard anything received but not read yet
+void flushSerialInput(SerialPort serial);
+
+// Gives up after SERIAL_TIMEOUT_MS if the device stops taking bytes
+// Returns number of bytes written, fewer than size on a timeout, or -1 on error
+int32_t writeSerial(SerialPort serial, const uint8_t* data, uint32_t size);
+
+// Scatter-gather write, so buffers are sent straight from where they live
+// POSIX hands all of them to writev at once, Windows has no gather write for serial handles
+// and batches them through a SERIAL_STAGING_SIZE stack buffer instead
+#define MAX_SERIAL_BUFFERS 256
+#define SERIAL_STAGING_SIZE 4096
+
+struct SerialBuffer {
+	const uint8_t* data;
+	uint32_t size;
+};
+
+// Returns total bytes written, fewer on a SERIAL_TIMEOUT_MS timeout, or -1 on error
+// A short write ends the call, no later buffer goes out after a gap
+int32_t writeSerialBuffers(SerialPort serial, const struct SerialBuffer* buffers, uint16_t count);
+
+// Returns as soon as any bytes are available, or after SERIAL_TIMEOUT_MS with none
+// Returns number of bytes read, or -1 on error or when the device hung up
+int32_t readSerial(SerialPort serial, uint8_t* buffer, uint32_t size);
+
+// Bytes a readSerial call would return without waiting, or -1 on error
+int32_t getSerialBytesAvailable(SerialPort serial);
+
+#endif
@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+
+#include "platform.h"
+#include "serial.h"
+
+speed_t getBaudConstant(uint32_t baudRate) {
+	switch (baudRate) {
+	case 9600:
+		return B9600;
+	case 57600:
+		return B57600;
+	case 115200:
+		return B115200;
+	case 230400:
+		return B230400;
+#ifdef B460800
+	case 460800:
+		return B460800;
+#endif
+#ifdef B921600
+	case 921600:
+		return B921600;
+#endif
+#ifdef B1000000
+	case 1000000:
+		return B1000000;
+#endif
+#ifdef B2000000
+	case 2000000:
+		return B2000000;
+#endif
+	default:
+		return B0;
+	}
+}
+
+SerialPort connectSerial(const char* port, uint32_t baudRate) {
+	// Open serial port using termios
+
+	// Non-blocking so reads and writes can give up after SERIAL_TIMEOUT_MS like the Win32 backend
+	int fd = open(port, O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+	if (fd < 0) {
+		printf("ERROR: Failed to open serial port %s\n", port);
+		return INVALID_SERIAL_PORT;
+	}
+	printf("Successfully opened serial port %s at %u baud\n", port, baudRate);
+
+	speed_t speed = getBaudConstant(baudRate);
+	if (speed == B0) {
+		printf("ERROR: Unsupported baud rate %u, using %u\n", baudRate, SERIAL_BAUD_RATE);
+		speed = getBaudConstant(SERIAL_BAUD_RATE);
+	}
+
+	struct termios state;
+	if (tcgetattr(fd, &state) == 0) {
+		cfmakeraw(&state);
+		cfsetispeed(&state, speed);
+		cfsetospeed(&state, speed);
+		state.c_cflag |= CLOCAL | CREAD;
+		state.c_cflag &= ~(CSTOPB | PARENB);
+
+		state.c_cc[VMIN] = 0;
+		state.c_cc[VTIME] = 0;
+		tcsetattr(fd, TCSANOW, &state);
+	}
+
+	return fd;
+}
+
+uint8_t setSerialBaudRate(SerialPort serial, uint32_t baudRate) {
+	speed_t speed = getBaudConstant(baudRate);
+	struct termios state;
+	if (speed == B0 || tcgetattr(serial, &state) != 0) {
+		return 0;
+	}
+	tcdrain(serial);
+	cfsetispeed(&state, speed);
+	cfsetospeed(&state, speed);
+	return tcsetattr(serial, TCSANOW, &state) == 0;
+}
+
+void flushSerialInput(SerialPort serial) {
+	tcflush(serial, TCIFLUSH);
+}
+
+void closeSerial(SerialPort serial) {
+	if (serial != INVALID_SERIAL_PORT) {
+		close(serial);
+	}
+}
+
+// Wait until the port is ready for events or the deadline passes, returns 0 on timeout and -1 on error or hangup
+int8_t waitSerial(SerialPort serial, short events, unsigned long long deadline) {
+	while (1) {
+		unsigned long long now = getNanos();
+		if (now >= deadline) {
+			return 0;
+		}
+		struct pollfd descriptor = { serial, events, 0 };
+		int result = poll(&descriptor, 1, (int) ((deadline - now + 999999) / 1000000));
+		if (result < 0 && errno == EINTR) {
+			continue;
+		}
+		if (result < 0 || (descriptor.revents & (POLLERR | POLLHUP | POLLNVAL))) {
+			return -1;
+		}
+		if (result > 0) {
+			return 1;
+		}
+	}
+}
+
+// Writes give up SERIAL_TIMEOUT_MS after the call and return what went out by then
+int32_t writeSerial(SerialPort serial, const uint8_t* data, uint32_t size) {
+	unsigned long long deadline = getNanos() + SERIAL_TIMEOUT_MS * 1000000ULL;
+	uint32_t totalWritten = 0;
+	while (totalWritten < size) {
+		ssize_t bytesWritten = write(serial, data + totalWritten, size - totalWritten);
+		if (bytesWritten < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				return -1;
+			}
+			int8_t isReady = waitSerial(serial, POLLOUT, deadline);
+			if (isReady < 0) {
+				return -1;
+			}
+			if (!isReady) {
+				break;
+			}
+			continue;
+		}
+		totalWritten += (uint32_t) bytesWritten;
+	}
+	return (int32_t) totalWritten;
+}
+
+// One writev call takes up to MAX_SERIAL_BUFFERS buffers
+int32_t writeSerialVector(SerialPort serial, const struct SerialBuffer* buffers, uint16_t count, uint32_t size) {
+	struct iovec vectors[MAX_SERIAL_BUFFERS];
+	for (uint16_t i = 0; i < count; ++i) {
+		vectors[i].iov_base = (void*) buffers[i].data;
+		vectors[i].iov_len = buffers[i].size;
+	}
+
+	// A short write leaves the rest of the vector for the next call
+	unsigned long long deadline = getNanos() + SERIAL_TIMEOUT_MS * 1000000ULL;
+	uint32_t totalWritten = 0;
+	struct iovec* vector = vectors;
+	uint16_t numVectors = count;
+	while (totalWritten < size) {
+		ssize_t bytesWritten = writev(serial, vector, numVectors);
+		if (bytesWritten < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				return -1;
+			}
+			int8_t isReady = waitSerial(serial, POLLOUT, deadline);
+			if (isReady < 0) {
+				return -1;
+			}
+			if (!isReady) {
+				break;
+			}
+			continue;
+		}
+		totalWritten += (uint32_t) bytesWritten;
+		while (numVectors && (size_t) bytesWritten >= vector->iov_len) {
+			bytesWritten -= vector->iov_len;
+			++vector;
+			--numVectors;
+		}
+		if (numVectors) {
+			vector->iov_base = (uint8_t*) vector->iov_base + bytesWritten;
+			vector->iov_len -= bytesWritten;
+		}
+	}
+	return (int32_t) totalWritten;
+}
+
+int32_t writeSerialBuffers(SerialPort serial, const struct SerialBuffer* buffers, uint16_t count) {
+	int32_t totalWritten = 0;
+	for (uint32_t i = 0; i < count; i += MAX_SERIAL_BUFFERS) {
+		uint16_t numBuffers = (count - i < MAX_SERIAL_BUFFERS) ? (uint16_t) (count - i) : MAX_SERIAL_BUFFERS;
+		uint32_t size = 0;
+		for (uint16_t j = 0; j < numBuffers; ++j) {
+			size += buffers[i + j].size;
+		}
+		int32_t bytesWritten = writeSerialVector(serial, buffers + i, numBuffers, size);
+		if (bytesWritten < 0) {
+			return -1;
+		}
+		totalWritten += bytesWritten;
+		// Like a single writev, a short write ends the call
+		if ((uint32_t) bytesWritten < size) {
+			break;
+		}
+	}
+	return totalWritten;
+}
+
+int32_t readSerial(SerialPort serial, uint8_t* buffer, uint32_t size) {
+	int8_t isReady = waitSerial(serial, POLLIN, getNanos() + SERIAL_TIMEOUT_MS * 1000000ULL);
+	if (isReady <= 0) {
+		return isReady;
+	}
+	ssize_t bytesRead;
+	do {
+		bytesRead = read(serial, buffer, size);
+	} while (bytesRead < 0 && errno == EINTR);
+	if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		return 0;
+	}
+	// Nothing to read from a port that polled ready means the device is gone
+	if (bytesRead == 0) {
+		return -1;
+	}
+	return (int32_t) bytesRead;
+}
+
+int32_t getSerialBytesAvailable(SerialPort serial) {
+	int bytesAvailable = 0;
+	if (ioctl(serial, FIONREAD, &bytesAvailable) < 0) {
+		return -1;
+	}
+	return (int32_t) bytesAvailable;
+}
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "serial.h"
+
+SerialPort connectSerial(const char* port, uint32_t baudRate) {
+	// Open serial port using Windows API
+
+	HANDLE hSerial = CreateFileA(port, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+
+	if (hSerial == INVALID_HANDLE_VALUE) {
+		printf("ERROR: Failed to open serial port %s\n", port);
+	}
+	else {
+		printf("Successfully opened serial port %s at %u baud\n", port, baudRate);
+	}
+
+	// Reads return as soon as any bytes are available
+	COMMTIMEOUTS timeouts = { 0 };
+	timeouts.ReadIntervalTimeout = MAXDWORD;
+	timeouts.ReadTotalTimeoutConstant = SERIAL_TIMEOUT_MS;
+	timeouts.ReadTotalTimeoutMultiplier = MAXDWORD;
+	timeouts.WriteTotalTimeoutConstant = SERIAL_TIMEOUT_MS;
+	timeouts.WriteTotalTimeoutMultiplier = 0;
+	SetCommTimeouts(hSerial, &timeouts);
+
+	DCB state = { 0 };
+	state.DCBlength = sizeof(DCB);
+	state.BaudRate = baudRate;
+	state.ByteSize = 8;
+	state.Parity = NOPARITY;
+	state.StopBits = ONESTOPBIT;
+	SetCommState(hSerial, &state);
+
+	return hSerial;
+}
+
+uint8_t setSerialBaudRate(SerialPort serial, uint32_t baudRate) {
+	DCB state = { 0 };
+	state.DCBlength = sizeof(DCB);
+	if (!FlushFileBuffers(serial) || !GetCommState(serial, &state)) {
+		return 0;
+	}
+	state.BaudRate = baudRate;
+	return SetCommState(serial, &state) != 0;
+}
+
+void flushSerialInput(SerialPort serial) {
+	PurgeComm(serial, PURGE_RXCLEAR);
+}
+
+void closeSerial(SerialPort serial) {
+	CloseHandle(serial);
+}
+
+int32_t writeSerial(SerialPort serial, const uint8_t* data, uint32_t size) {
+	DWORD bytesWritten = 0;
+	if (!WriteFile(serial, data, size, &bytesWritten, NULL)) {
+		return -1;
+	}
+	return (int32_t) bytesWritten;
+}
+
+// Adds what went out to totalWritten, returns 0 unless all of it did
+uint8_t writeSerialPart(SerialPort serial, const uint8_t* data, uint32_t size, int32_t* totalWritten) {
+	int32_t bytesWritten = writeSerial(serial, data, size);
+	if (bytesWritten < 0) {
+		*totalWritten = -1;
+		return 0;
+	}
+	*totalWritten += bytesWritten;
+	return (uint32_t) bytesWritten == size;
+}
+
+int32_t writeSerialBuffers(SerialPort serial, const struct SerialBuffer* buffers, uint16_t count) {
+	uint8_t staging[SERIAL_STAGING_SIZE];
+	uint32_t stagedSize = 0;
+	int32_t totalWritten = 0;
+	// A short write stops here like writev, later buffers would leave a hole in the stream
+	for (uint16_t i = 0; i < count; ++i) {
+		// Buffers too large to stage go out on their own
+		if (stagedSize + buffers[i].size > SERIAL_STAGING_SIZE || buffers[i].size > SERIAL_STAGING_SIZE) {
+			if (stagedSize) {
+				if (!writeSerialPart(serial, staging, stagedSize, &totalWritten)) {
+					return totalWritten;
+				}
+				stagedSize = 0;
+			}
+			if (buffers[i].size > SERIAL_STAGING_SIZE) {
+				if (!writeSerialPart(serial, buffers[i].data, buffers[i].size, &totalWritten)) {
+					return totalWritten;
+				}
+				continue;
+			}
+		}
+		memcpy(&staging[stagedSize], buffers[i].data, buffers[i].size);
+		stagedSize += buffers[i].size;
+	}
+	if (stagedSize) {
+		writeSerialPart(serial, staging, stagedSize, &totalWritten);
+	}
+	return totalWritten;
+}
+
+int32_t readSerial(SerialPort serial, uint8_t* buffer, uint32_t size) {
+	DWORD bytesRead = 0;
+	if (!ReadFile(serial, buffer, size, &bytesRead, NULL)) {
+		return -1;
+	}
+	return (int32_t) bytesRead;
+}
+
+int32_t getSerialBytesAvailable(SerialPort serial) {
+	COMSTAT status;
+	DWORD errors;
+	if (!ClearCommError(serial, &errors, &status)) {
+		return -1;
+	}
+	return (int32_t) status.cbInQue;
+}
@@ -0,0 +1,61 @@
+#include <string.h>
+
+#include "txqueue.h"
+
+void clearTransmitQueue(struct TransmitQueue* queue) {
+	queue->dataSize = 0;
+	queue->numBuffers = 0;
+	queue->size = 0;
+}
+
+// Index of a queued droppable packet that the new one replaces, or numBuffers if none
+// Packets start with CMD_BYTE and the command, which decides the size, so a matching command has room for the new packet
+uint16_t findReplacedPacket(struct TransmitQueue* queue, const uint8_t* packet, uint32_t size) {
+	for (uint16_t i = 0; i < queue->numBuffers; ++i) {
+		if (queue->priorities[i] == TRANSMIT_DROPPABLE && queue->buffers[i].size == size && size >= 2 && queue->buffers[i].data[1] == packet[1]) {
+			return i;
+		}
+	}
+	return queue->numBuffers;
+}
+
+enum QueueResult queuePacket(struct TransmitQueue* queue, enum TransmitPriority priority, const uint8_t* packet, uint16_t size) {
+	if (priority == TRANSMIT_DROPPABLE) {
+		uint16_t i = findReplacedPacket(queue, packet, size);
+		if (i < queue->numBuffers && queue->buffers[i].data >= queue->data && queue->buffers[i].data < queue->data + TRANSMIT_QUEUE_SIZE) {
+			memcpy((uint8_t*) queue->buffers[i].data, packet, size);
+			return QUEUE_REPLACED;
+		}
+	}
+	if (queue->numBuffers == MAX_TRANSMIT_PACKETS || TRANSMIT_QUEUE_SIZE - queue->dataSize < size) {
+		return QUEUE_FULL;
+	}
+	uint8_t* data = queue->data + queue->dataSize;
+	memcpy(data, packet, size);
+	queue->dataSize += size;
+	queue->buffers[queue->numBuffers].data = data;
+	queue->buffers[queue->numBuffers].size = size;
+	queue->priorities[queue->numBuffers] = (uint8_t) priority;
+	++queue->numBuffers;
+	queue->size += size;
+	return QUEUE_ADDED;
+}
+
+enum QueueResult queuePacketReference(struct TransmitQueue* queue, enum TransmitPriority priority, const uint8_t* packet, uint32_t size) {
+	if (priority == TRANSMIT_DROPPABLE) {
+		uint16_t i = findReplacedPacket(queue, packet, size);
+		if (i < queue->numBuffers) {
+			queue->buffers[i].data = packet;
+			return QUEUE_REPLACED;
+		}
+	}
+	if (queue->numBuffers == MAX_TRANSMIT_PACKETS) {
+		return QUEUE_FULL;
+	}
+	queue->buffers[queue->numBuffers].data = packet;
+	queue->buffers[queue->numBuffers].size = size;
+	queue->priorities[queue->numBuffers] = (uint8_t) priority;
+	++queue->numBuffers;
+	queue->size += size;
+	return QUEUE_ADDED;
+}
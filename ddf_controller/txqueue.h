@@ -0,0 +1,45 @@
+#ifndef TXQUEUE_H
+#define TXQUEUE_H
+
+#include <stdint.h>
+
+#include "serial.h"
+
+// Packets for one writer tick, collected and sent to the FPGA in a single gather write
+// Small packets are copied into the queue, large ones (tiles, cached frames) are referenced and must stay valid until the flush
+// Droppable packets only carry state that a later packet replaces, a newer one with the same command replaces the queued one
+// and they are dropped instead of forcing an extra write when the queue is full
+// Reliable packets are never dropped, a full queue is flushed early to make room for them
+#define TRANSMIT_QUEUE_SIZE 1024  // Bytes of copied packets, holds any single packet
+#define MAX_TRANSMIT_PACKETS MAX_SERIAL_BUFFERS
+
+enum TransmitPriority {
+	TRANSMIT_DROPPABLE,  // Pong positions
+	TRANSMIT_RELIABLE  // Scores, rows, tiles, latches and mode changes
+};
+
+enum QueueResult {
+	QUEUE_ADDED,
+	QUEUE_REPLACED,  // Took the place of a queued droppable packet with the same command
+	QUEUE_FULL
+};
+
+// Only used by the writer thread that owns it
+struct TransmitQueue {
+	uint8_t data[TRANSMIT_QUEUE_SIZE];
+	uint16_t dataSize;
+	struct SerialBuffer buffers[MAX_TRANSMIT_PACKETS];  // In send order, point into data or at referenced packets
+	uint8_t priorities[MAX_TRANSMIT_PACKETS];
+	uint16_t numBuffers;
+	uint32_t size;  // Bytes in the queue
+};
+
+void clearTransmitQueue(struct TransmitQueue* queue);
+
+// Copy a packet into the queue
+enum QueueResult queuePacket(struct TransmitQueue* queue, enum TransmitPriority priority, const uint8_t* packet, uint16_t size);
+
+// Queue a packet without copying it
+enum QueueResult queuePacketReference(struct TransmitQueue* queue, enum TransmitPriority priority, const uint8_t* packet, uint32_t size);
+
+#endif
@@ -0,0 +1,80 @@
+// Reads the running controller's metrics segment
+// Prints one CSV row per period, counters as totals and bytes/s over the period
+//
+// Usage: ddf_metrics [period ms]
+// A period of 0 prints a single row and exits
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../ddf_controller/effects.h"
+#include "../ddf_controller/metrics.h"
+#include "../ddf_controller/platform.h"
+
+#define DEFAULT_PERIOD_MS 1000
+
+const char* animationModeNames[] = { "off", "solid", "wave", "rainbow", "alternating", "pong", "spectrum", "plasma" };
+const char* colorModeNames[] = { "rainbow", "red", "orange", "yellow", "green", "blue", "purple", "white", "red_blue", "green_blue" };
+
+const char* getName(const char** names, uint32_t numNames, uint32_t index) {
+	return (index < numNames) ? names[index] : "unknown";
+}
+
+int main(int argc, char** argv) {
+	uint32_t periodMs = (argc > 1) ? (uint32_t) strtoul(argv[1], NULL, 10) : DEFAULT_PERIOD_MS;
+
+	struct SharedMemory memory;
+	struct MetricsSegment* segment = openMetrics(&memory);
+	if (!segment) {
+		printf("ERROR: No controller metrics at %s\n", METRICS_NAME);
+		return 1;
+	}
+
+	printf(
+		"animation_mode,color_mode,baud_rate,render_fps,write_fps,frames_rendered,frames_published,frames_dropped,frames_written,"
+		"bytes_per_s,write_timeouts,write_errors,arduino_bytes,audio_consumed,audio_discarded,cache_hits,cache_misses,beats,bass,low_mid,high_mid,treble,output_latency_us,pipeline_latency_us,pixel_tiles,render_threads,tiles_stolen,outputs"
+	);
+	for (uint8_t i = 0; i < MAX_FPGA_OUTPUTS; ++i) {
+		printf(",fpga%u_bytes_per_s", i);
+	}
+	printf(",serial_writes,packets_dropped,framed_outputs,link_errors,credit_stalls\n");
+
+	struct MetricsValues values;
+	readMetrics(segment, &values);
+	struct MetricsValues lastValues = values;
+	while (1) {
+		double seconds = (values.updateTimeNanos - lastValues.updateTimeNanos) / 1000000000.0;
+		double bytesPerSecond = (seconds > 0) ? (uint32_t) (values.fpgaBytesWritten - lastValues.fpgaBytesWritten) / seconds : 0;
+		printf(
+			"%s,%s,%u,%.1f,%.1f,%u,%u,%u,%u,%.0f,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u",
+			getName(animationModeNames, sizeof(animationModeNames) / sizeof(animationModeNames[0]), values.animationMode),
+			getName(colorModeNames, sizeof(colorModeNames) / sizeof(colorModeNames[0]), values.colorMode),
+			values.fpgaBaudRate, values.renderMilliFps / 1000.0, values.writeMilliFps / 1000.0,
+			values.framesRendered, values.framesPublished, values.framesDropped, values.framesWritten,
+			bytesPerSecond, values.fpgaWriteTimeouts, values.fpgaWriteErrors,
+			values.arduinoBytesRead, values.audioSamplesConsumed, values.audioSamplesDiscarded,
+			values.frameCacheHits, values.frameCacheMisses, values.beatsDetected,
+			values.audioBandLevels[0], values.audioBandLevels[1], values.audioBandLevels[2], values.audioBandLevels[3],
+			values.outputLatencyMicros, values.pipelineLatencyMicros, values.pixelTilesWritten, values.renderThreads, values.renderTilesStolen, values.numFpgaOutputs
+		);
+		for (uint8_t i = 0; i < MAX_FPGA_OUTPUTS; ++i) {
+			printf(",%.0f", (seconds > 0) ? (uint32_t) (values.fpgaOutputBytesWritten[i] - lastValues.fpgaOutputBytesWritten[i]) / seconds : 0);
+		}
+		printf(
+			",%u,%u,%u,%u,%u\n",
+			values.fpgaSerialWrites, values.fpgaPacketsDropped, values.numFramedFpgaOutputs, values.fpgaLinkErrors, values.fpgaCreditStalls
+		);
+		fflush(stdout);
+
+		if (!periodMs) {
+			break;
+		}
+		sleepMillis(periodMs);
+		lastValues = values;
+		readMetrics(segment, &values);
+	}
+
+	closeSharedMemory(&memory);
+	return 0;
+}
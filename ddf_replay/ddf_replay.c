@@ -0,0 +1,195 @@
+// Replays a log recorded by ddf_controller
+// Arduino bytes go out on a pseudo-terminal standing in for the Arduino, FPGA packets go to an optional FPGA port
+//
+// Usage: ddf_replay <log> [speed] [FPGA port]
+// Speed scales the recorded timing (default 1 for real time, 0 for as fast as possible)
+// Pass the printed device path to ddf_controller as its Arduino port, the replay starts on Enter
+// The FPGA port can be the wall or a fake_fpga pseudo-terminal, and follows the recorded baud rate changes
+
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../ddf_controller/platform.h"
+#include "../ddf_controller/recorder.h"
+#include "../ddf_controller/serial.h"
+
+struct ReplayStats {
+	unsigned long long records;
+	unsigned long long fpgaPackets;
+	unsigned long long fpgaBytes;
+	unsigned long long arduinoBytes;
+	unsigned long long baudRateChanges;
+	unsigned long long maxLateNanos;  // Furthest behind the recorded timing
+	unsigned long long lastTimeNanos;
+};
+
+void sleepNanos(unsigned long long nanos) {
+	struct timespec ts;
+	ts.tv_sec = (time_t) (nanos / 1000000000);
+	ts.tv_nsec = (long) (nanos % 1000000000);
+	nanosleep(&ts, NULL);
+}
+
+// Blocks while the controller is not keeping up
+uint8_t writeAll(int fd, const uint8_t* data, uint16_t size) {
+	while (size) {
+		ssize_t bytesWritten = write(fd, data, size);
+		if (bytesWritten <= 0) {
+			return 0;
+		}
+		data += bytesWritten;
+		size -= (uint16_t) bytesWritten;
+	}
+	return 1;
+}
+
+// Writes time out, so keep going until a slow FPGA has taken the whole packet
+uint8_t writeAllSerial(SerialPort serial, const uint8_t* data, uint16_t size) {
+	while (size) {
+		int32_t bytesWritten = writeSerial(serial, data, size);
+		if (bytesWritten < 0) {
+			return 0;
+		}
+		data += bytesWritten;
+		size -= (uint16_t) bytesWritten;
+	}
+	return 1;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		printf("Usage: ddf_replay <log> [speed] [FPGA port]\n");
+		return 1;
+	}
+	const char* logPath = argv[1];
+	double speed = (argc > 2) ? strtod(argv[2], NULL) : 1.0;
+	const char* fpgaPort = (argc > 3) ? argv[3] : NULL;
+
+	// Map the whole log, records are parsed in place
+	int logFile = open(logPath, O_RDONLY);
+	struct stat logStat;
+	if (logFile < 0 || fstat(logFile, &logStat) != 0 || logStat.st_size == 0) {
+		printf("ERROR: Failed to open log %s\n", logPath);
+		return 1;
+	}
+	size_t logSize = (size_t) logStat.st_size;
+	const uint8_t* log = (const uint8_t*) mmap(NULL, logSize, PROT_READ, MAP_PRIVATE, logFile, 0);
+	close(logFile);
+	if (log == MAP_FAILED) {
+		printf("ERROR: Failed to map log %s\n", logPath);
+		return 1;
+	}
+	madvise((void*) log, logSize, MADV_SEQUENTIAL);
+
+	size_t offset = 0;
+	struct Record record;
+	uint8_t hasRecord = readRecord(log, logSize, &offset, &record);
+	if (!offset) {
+		printf("ERROR: %s is not a version %d record log\n", logPath, RECORD_VERSION);
+		return 1;
+	}
+
+	int arduinoMaster = posix_openpt(O_RDWR | O_NOCTTY);
+	if (arduinoMaster < 0 || grantpt(arduinoMaster) != 0 || unlockpt(arduinoMaster) != 0) {
+		printf("ERROR: Failed to create pseudo-terminal\n");
+		return 1;
+	}
+	const char* slaveName = ptsname(arduinoMaster);
+
+	// Keep the slave open so writes never fail between controller reconnects
+	int slave = open(slaveName, O_RDWR | O_NOCTTY);
+	struct termios state;
+	tcgetattr(slave, &state);
+	cfmakeraw(&state);
+	tcsetattr(slave, TCSANOW, &state);
+
+	SerialPort fpgaSerial = INVALID_SERIAL_PORT;
+	if (fpgaPort) {
+		fpgaSerial = connectSerial(fpgaPort, SERIAL_BAUD_RATE);
+		if (fpgaSerial == INVALID_SERIAL_PORT) {
+			return 1;
+		}
+	}
+
+	printf("Arduino port: %s\n", slaveName);
+	printf("Press Enter to start\n");
+	fflush(stdout);
+	getchar();
+
+	struct ReplayStats stats = { 0 };
+	unsigned long long startTime = getNanos();
+	while (hasRecord) {
+		if (speed > 0) {
+			unsigned long long targetTime = startTime + (unsigned long long) (record.timeNanos / speed);
+			unsigned long long now = getNanos();
+			if (targetTime > now) {
+				sleepNanos(targetTime - now);
+			}
+			else if (now - targetTime > stats.maxLateNanos) {
+				stats.maxLateNanos = now - targetTime;
+			}
+		}
+
+		switch (record.type) {
+		case RECORD_FPGA_PACKET:
+			if (fpgaSerial != INVALID_SERIAL_PORT && !writeAllSerial(fpgaSerial, record.data, record.size)) {
+				printf("ERROR: Failed to write FPGA packet\n");
+			}
+			++stats.fpgaPackets;
+			stats.fpgaBytes += record.size;
+			break;
+		case RECORD_ARDUINO_BYTES:
+			if (!writeAll(arduinoMaster, record.data, record.size)) {
+				printf("ERROR: Failed to write Arduino bytes\n");
+			}
+			stats.arduinoBytes += record.size;
+			break;
+		case RECORD_FPGA_BAUD_RATE:
+			if (fpgaSerial != INVALID_SERIAL_PORT && record.size == 4) {
+				uint32_t baudRate = record.data[0] | record.data[1] << 8 | record.data[2] << 16 | (uint32_t) record.data[3] << 24;
+				if (!setSerialBaudRate(fpgaSerial, baudRate)) {
+					printf("ERROR: Baud rate %u is not supported\n", baudRate);
+				}
+			}
+			++stats.baudRateChanges;
+			break;
+		}
+		++stats.records;
+		stats.lastTimeNanos = record.timeNanos;
+
+		hasRecord = readRecord(log, logSize, &offset, &record);
+	}
+
+	double elapsedSeconds = (getNanos() - startTime) / 1000000000.0;
+	double recordedSeconds = stats.lastTimeNanos / 1000000000.0;
+	if (offset != logSize) {
+		printf("WARNING: Log is truncated after %llu records\n", stats.records);
+	}
+	printf(
+		"records: %llu  fpga packets: %llu (%llu bytes)  arduino bytes: %llu  baud rate changes: %llu\n",
+		stats.records, stats.fpgaPackets, stats.fpgaBytes, stats.arduinoBytes, stats.baudRateChanges
+	);
+	printf(
+		"recorded s: %.3f  replayed s: %.3f  bytes/s: %.0f  max late us: %.1f\n",
+		recordedSeconds, elapsedSeconds, (stats.fpgaBytes + stats.arduinoBytes) / (elapsedSeconds > 0 ? elapsedSeconds : 1),
+		stats.maxLateNanos / 1000.0
+	);
+
+	if (fpgaSerial != INVALID_SERIAL_PORT) {
+		closeSerial(fpgaSerial);
+	}
+	close(slave);
+	close(arduinoMaster);
+	munmap((void*) log, logSize);
+	return 0;
+}
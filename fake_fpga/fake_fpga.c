@@ -0,0 +1,595 @@
+// Stand-in for the LED wall FPGA on a pseudo-terminal
+// Parses the controller's serial protocol and reports throughput once per second
+//
+// Usage: fake_fpga [baud rate] [max baud rate] [receive buffer size] [frame error period]
+// Pass the printed device path to ddf_controller as its FPGA port
+// Reads are paced to the given baud rate (default 115200, 0 for unlimited) so writes back up like a real UART
+// The controller can switch rates with SET_BAUD_RATE_CODE, anything above max baud rate (default 2000000) is received as garbage
+// and so is anything the controller sends with its side of the pty set to another rate than the emulated one
+// Framed links get credit for the receive buffer size (default 8192, 0 to not support framing) past the frame bytes parsed so far,
+// and with a frame error period every that many frames is dropped as if its CRC failed
+
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <time.h>
+
+#include "../ddf_controller/protocol.h"
+
+#define REPORT_PERIOD_US 1000000
+#define READ_CHUNK_SIZE 256
+#define BITS_PER_BYTE 10  // 8N1 framing
+#define DEFAULT_BAUD_RATE 115200
+#define DEFAULT_MAX_BAUD_RATE 2000000
+#define DEFAULT_RECEIVE_BUFFER_SIZE 8192
+#define LINK_FRAME_FIELDS_SIZE (LINK_FRAME_HEADER_SIZE - 2)  // Version, sequence and payload size
+#define MAX_PAYLOAD_SIZE (LINK_FRAME_FIELDS_SIZE + MAX_LINK_FRAME_PAYLOAD + LINK_FRAME_TRAILER_SIZE)
+
+enum ParserState {
+	WAIT_CMD_BYTE,
+	WAIT_CODE,
+	WAIT_PAYLOAD
+};
+
+struct Parser {
+	enum ParserState state;
+	uint8_t code;
+	uint16_t payloadSize;
+	uint16_t bytesReceived;
+	uint8_t payload[MAX_PAYLOAD_SIZE];
+	unsigned long long packetStartTime;
+	uint8_t lastCode;
+	uint8_t lastRangeStart;
+	uint8_t isLatchMode;  // Frames are counted when latched rather than as rows arrive
+	struct Parser* frameParser;  // Parses the packets inside link frames, NULL if framing is not supported here
+	uint8_t isInFrame;  // Parses link frame contents, whose latency is the frame's
+};
+
+// Emulated UART
+struct Line {
+	int fd;
+	unsigned long baudRate;
+	unsigned long powerOnBaudRate;
+	unsigned long maxBaudRate;
+	unsigned long long startTime;  // Pacing restarts whenever the rate changes
+	unsigned long long totalBytes;
+	unsigned long long switchTime;
+	uint8_t isProbed;  // A valid probe arrived since the last rate switch
+
+	// Rate the controller set its side of the pty to, bytes it sends at any other rate than baudRate are garbage
+	int slave;
+	unsigned long hostBaudRate;
+	unsigned long lastHostBaudRate;
+	unsigned long lastHostRateBytes;  // Unread bytes sent before the controller last switched rates
+
+	// Framed link
+	unsigned long receiveBufferSize;
+	unsigned long frameErrorPeriod;  // 0 for no injected errors
+	unsigned long framesUntilError;
+	uint32_t frameBytesConsumed;  // Since GET_LINK_STATUS_CODE, wraps
+	uint8_t nextSequence;
+	uint8_t lastSequence;
+	uint8_t isFrameDropped;  // A damaged frame was dropped since the last good one, so the sequence gap is already counted
+	uint8_t linkErrorCount;  // Wraps
+};
+
+struct Stats {
+	unsigned long long bytes;
+	unsigned long long frames;
+	unsigned long long packets[256];
+	unsigned long long resyncs;
+	unsigned long long linkErrors;
+	unsigned long long latencyCount;
+	unsigned long long latencyTotal;
+	unsigned long long latencyMin;
+	unsigned long long latencyMax;
+};
+
+unsigned long long getMicros() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void resetStats(struct Stats* stats) {
+	stats->bytes = 0;
+	stats->frames = 0;
+	for (uint16_t i = 0; i < 256; ++i) {
+		stats->packets[i] = 0;
+	}
+	stats->resyncs = 0;
+	stats->linkErrors = 0;
+	stats->latencyCount = 0;
+	stats->latencyTotal = 0;
+	stats->latencyMin = (unsigned long long) -1;
+	stats->latencyMax = 0;
+}
+
+// Payload size for a command code once any size fields are known, 0 for unknown codes
+uint16_t getPayloadSize(struct Parser* parser) {
+	switch (parser->code) {
+	case SET_ROWS_COLOR_CODE:
+		return 3 * LED_ROWS;
+	case SET_PONG_DATA_CODE:
+		return PONG_DATA_PACKET_SIZE - 2;
+	case SET_PONG_SCORE_CODE:
+		return PONG_SCORE_PACKET_SIZE - 2;
+	case SET_ROW_RANGE_COLOR_CODE:
+	case SET_FULL_RES_RANGE_CODE:
+		if (parser->bytesReceived < 2) {
+			return 2;
+		}
+		return 2 + 3 * parser->payload[1];
+	case SET_FULL_RES_ROWS_CODE:
+		return FULL_RES_ROWS_PACKET_SIZE - 2;
+	case SET_FULL_RES_RLE_CODE:
+		if (parser->bytesReceived < 1) {
+			return 1;
+		}
+		return 1 + FULL_RES_RLE_RUN_SIZE * parser->payload[0];
+	case SET_FULL_RES_DELTA_CODE:
+		return FULL_RES_DELTA_PACKET_SIZE - 2;
+	case SET_PALETTE_CODE:
+		if (parser->bytesReceived < 1) {
+			return 1;
+		}
+		return 1 + 3 * parser->payload[0];
+	case SET_INDEXED_ROWS_4_CODE:
+		return INDEXED_ROWS_4_PACKET_SIZE - 2;
+	case SET_INDEXED_ROWS_8_CODE:
+		return INDEXED_ROWS_8_PACKET_SIZE - 2;
+	case SET_BAUD_RATE_CODE:
+		return SET_BAUD_RATE_PACKET_SIZE - 2;
+	case PROBE_CODE:
+		return PROBE_PATTERN_SIZE;
+	case SET_LATCH_MODE_CODE:
+		return SET_LATCH_MODE_PACKET_SIZE - 2;
+	case LATCH_FRAME_CODE:
+		return LATCH_FRAME_PACKET_SIZE - 2;
+	case SET_PIXEL_TILE_CODE:
+		return PIXEL_TILE_PACKET_SIZE - 2;
+	case LINK_FRAME_CODE:
+		if (!parser->frameParser) {
+			return 0;
+		}
+		if (parser->bytesReceived < LINK_FRAME_FIELDS_SIZE) {
+			return LINK_FRAME_FIELDS_SIZE;
+		}
+		return LINK_FRAME_FIELDS_SIZE + ((parser->payload[2] << 8) | parser->payload[3]) + LINK_FRAME_TRAILER_SIZE;
+	case GET_LINK_STATUS_CODE:
+		return parser->frameParser ? GET_LINK_STATUS_PACKET_SIZE - 2 : 0;
+	default:
+		return 0;
+	}
+}
+
+uint16_t getChecksum(const uint8_t* data, uint16_t size) {
+	uint16_t sum1 = 0;
+	uint16_t sum2 = 0;
+	for (uint16_t i = 0; i < size; ++i) {
+		sum1 = (sum1 + data[i]) % 255;
+		sum2 = (sum2 + sum1) % 255;
+	}
+	return (sum2 << 8) | sum1;
+}
+
+// CRC-16/CCITT-FALSE
+uint16_t getLinkCrc(const uint8_t* data, uint32_t size) {
+	uint16_t crc = LINK_CRC_INIT;
+	for (uint32_t i = 0; i < size; ++i) {
+		crc ^= (uint16_t) (data[i] << 8);
+		for (uint8_t j = 0; j < 8; ++j) {
+			crc = (crc & 0x8000) ? (uint16_t) ((crc << 1) ^ 0x1021) : (uint16_t) (crc << 1);
+		}
+	}
+	return crc;
+}
+
+void sendLinkStatus(struct Line* line) {
+	uint32_t creditLimit = line->frameBytesConsumed + (uint32_t) line->receiveBufferSize;
+	uint8_t status[LINK_STATUS_PACKET_SIZE] = {
+		CMD_BYTE, LINK_STATUS_CODE, LINK_VERSION, line->lastSequence,
+		creditLimit >> 24, (creditLimit >> 16) & 0xFF, (creditLimit >> 8) & 0xFF, creditLimit & 0xFF,
+		line->linkErrorCount
+	};
+	uint16_t crc = getLinkCrc(status + 2, LINK_STATUS_PACKET_SIZE - 2 - LINK_FRAME_TRAILER_SIZE);
+	status[LINK_STATUS_PACKET_SIZE - 2] = crc >> 8;
+	status[LINK_STATUS_PACKET_SIZE - 1] = crc & 0xFF;
+	if (write(line->fd, status, LINK_STATUS_PACKET_SIZE) != LINK_STATUS_PACKET_SIZE) {
+		printf("ERROR: Failed to send link status\n");
+	}
+}
+
+void parseByte(struct Parser* parser, struct Stats* stats, struct Line* line, uint8_t byte, unsigned long long now);
+
+// Check a whole frame and parse the packets in it
+void finishLinkFrame(struct Parser* parser, struct Stats* stats, struct Line* line, unsigned long long now) {
+	uint16_t payloadSize = (parser->payload[2] << 8) | parser->payload[3];
+	uint16_t crc = getLinkCrc(parser->payload, LINK_FRAME_FIELDS_SIZE + payloadSize);
+	const uint8_t* trailer = parser->payload + LINK_FRAME_FIELDS_SIZE + payloadSize;
+	uint8_t isInjectedError = line->frameErrorPeriod && --line->framesUntilError == 0;
+	if (isInjectedError) {
+		line->framesUntilError = line->frameErrorPeriod;
+	}
+
+	if (isInjectedError || parser->payload[0] != LINK_VERSION || trailer[0] != (crc >> 8) || trailer[1] != (crc & 0xFF)) {
+		++line->linkErrorCount;
+		++stats->linkErrors;
+		line->isFrameDropped = 1;
+	}
+	else {
+		// Frames before this one went missing
+		if (parser->payload[1] != line->nextSequence && !line->isFrameDropped) {
+			++line->linkErrorCount;
+			++stats->linkErrors;
+		}
+		line->isFrameDropped = 0;
+		line->lastSequence = parser->payload[1];
+		line->nextSequence = parser->payload[1] + 1;
+
+		struct Parser* frameParser = parser->frameParser;
+		frameParser->state = WAIT_CMD_BYTE;
+		for (uint16_t i = 0; i < payloadSize; ++i) {
+			parseByte(frameParser, stats, line, parser->payload[LINK_FRAME_FIELDS_SIZE + i], now);
+		}
+		// Packets never span frames
+		if (frameParser->state != WAIT_CMD_BYTE) {
+			++stats->resyncs;
+		}
+	}
+
+	// The frame is out of the receive buffer either way
+	line->frameBytesConsumed += LINK_FRAME_OVERHEAD + payloadSize;
+	sendLinkStatus(line);
+}
+
+void setLineBaudRate(struct Line* line, unsigned long baudRate, unsigned long long now) {
+	line->baudRate = baudRate;
+	line->startTime = now;
+	line->totalBytes = 0;
+	line->switchTime = now;
+	printf("Switched to %lu baud\n", baudRate);
+	fflush(stdout);
+}
+
+unsigned long getSpeedBaudRate(speed_t speed) {
+	switch (speed) {
+	case B9600:
+		return 9600;
+	case B57600:
+		return 57600;
+	case B115200:
+		return 115200;
+	case B230400:
+		return 230400;
+#ifdef B460800
+	case B460800:
+		return 460800;
+#endif
+#ifdef B921600
+	case B921600:
+		return 921600;
+#endif
+#ifdef B1000000
+	case B1000000:
+		return 1000000;
+#endif
+#ifdef B2000000
+	case B2000000:
+		return 2000000;
+#endif
+	default:
+		return 0;
+	}
+}
+
+// Notice the controller switching rates, bytes already waiting were sent at the old rate
+// The controller waits after SET_BAUD_RATE_CODE before sending at the new rate, so polling once per loop is enough
+void updateHostBaudRate(struct Line* line) {
+	struct termios state;
+	if (tcgetattr(line->slave, &state) != 0) {
+		return;
+	}
+	unsigned long hostBaudRate = getSpeedBaudRate(cfgetospeed(&state));
+	if (hostBaudRate == line->hostBaudRate) {
+		return;
+	}
+	// Before the controller first set a rate there was nothing to send
+	int pendingBytes = 0;
+	if (line->hostBaudRate && ioctl(line->fd, FIONREAD, &pendingBytes) == 0 && pendingBytes > 0) {
+		line->lastHostBaudRate = line->hostBaudRate;
+		line->lastHostRateBytes = (unsigned long) pendingBytes;
+	}
+	line->hostBaudRate = hostBaudRate;
+}
+
+void finishPacket(struct Parser* parser, struct Stats* stats, struct Line* line, unsigned long long now) {
+	++stats->packets[parser->code];
+
+	if (parser->code == SET_BAUD_RATE_CODE) {
+		setLineBaudRate(line, ((parser->payload[0] << 8) | parser->payload[1]) * 100UL, now);
+		line->isProbed = 0;
+	}
+	else if (parser->code == PROBE_CODE) {
+		uint16_t checksum = getChecksum(parser->payload, PROBE_PATTERN_SIZE);
+		uint8_t reply[PROBE_REPLY_SIZE] = { CMD_BYTE, PROBE_CODE, checksum >> 8, checksum & 0xFF };
+		if (write(line->fd, reply, PROBE_REPLY_SIZE) != PROBE_REPLY_SIZE) {
+			printf("ERROR: Failed to answer probe\n");
+		}
+		line->isProbed = 1;
+	}
+	else if (parser->code == SET_LATCH_MODE_CODE) {
+		parser->isLatchMode = parser->payload[0];
+	}
+	else if (parser->code == LINK_FRAME_CODE) {
+		finishLinkFrame(parser, stats, line, now);
+	}
+	else if (parser->code == GET_LINK_STATUS_CODE) {
+		// Hosts asking for another version get no answer and fall back to bare packets
+		if (parser->payload[0] == LINK_VERSION) {
+			line->frameBytesConsumed = 0;
+			line->nextSequence = 0;
+			line->lastSequence = 0xFF;
+			line->isFrameDropped = 0;
+			line->linkErrorCount = 0;
+			sendLinkStatus(line);
+		}
+	}
+
+	// Range packets from one frame arrive in increasing row order, and tiles in increasing tile order
+	// In latch mode row packets only fill the back buffer, pong is drawn by the FPGA and still counts
+	switch (parser->code) {
+	case SET_PONG_DATA_CODE:
+	case LATCH_FRAME_CODE:
+		++stats->frames;
+		break;
+	case SET_ROWS_COLOR_CODE:
+	case SET_FULL_RES_ROWS_CODE:
+	case SET_FULL_RES_RLE_CODE:
+	case SET_FULL_RES_DELTA_CODE:
+	case SET_INDEXED_ROWS_4_CODE:
+	case SET_INDEXED_ROWS_8_CODE:
+		if (!parser->isLatchMode) {
+			++stats->frames;
+		}
+		break;
+	case SET_ROW_RANGE_COLOR_CODE:
+	case SET_FULL_RES_RANGE_CODE:
+	case SET_PIXEL_TILE_CODE:
+		if (!parser->isLatchMode && (parser->lastCode != parser->code || parser->payload[0] <= parser->lastRangeStart)) {
+			++stats->frames;
+		}
+		parser->lastRangeStart = parser->payload[0];
+		break;
+	}
+	parser->lastCode = parser->code;
+
+	if (parser->isInFrame) {
+		return;
+	}
+	unsigned long long latency = now - parser->packetStartTime;
+	++stats->latencyCount;
+	stats->latencyTotal += latency;
+	if (latency < stats->latencyMin) {
+		stats->latencyMin = latency;
+	}
+	if (latency > stats->latencyMax) {
+		stats->latencyMax = latency;
+	}
+}
+
+void parseByte(struct Parser* parser, struct Stats* stats, struct Line* line, uint8_t byte, unsigned long long now) {
+	switch (parser->state) {
+	case WAIT_CMD_BYTE:
+		if (byte == CMD_BYTE) {
+			parser->state = WAIT_CODE;
+			parser->packetStartTime = now;
+		}
+		else {
+			++stats->resyncs;
+		}
+		break;
+	case WAIT_CODE:
+		parser->code = byte;
+		parser->bytesReceived = 0;
+		parser->payloadSize = getPayloadSize(parser);
+		if (parser->payloadSize == 0) {
+			++stats->resyncs;
+			parser->state = WAIT_CMD_BYTE;
+		}
+		else {
+			parser->state = WAIT_PAYLOAD;
+		}
+		break;
+	case WAIT_PAYLOAD:
+		parser->payload[parser->bytesReceived++] = byte;
+		if ((parser->code == SET_ROW_RANGE_COLOR_CODE || parser->code == SET_FULL_RES_RANGE_CODE) && parser->bytesReceived == 2) {
+			parser->payloadSize = getPayloadSize(parser);
+			uint8_t numRows = (parser->code == SET_ROW_RANGE_COLOR_CODE) ? LED_ROWS : FULL_LED_ROWS;
+			if (parser->payload[0] + parser->payload[1] > numRows) {
+				++stats->resyncs;
+				parser->state = WAIT_CMD_BYTE;
+				break;
+			}
+		}
+		if (parser->code == SET_FULL_RES_RLE_CODE && parser->bytesReceived == 1) {
+			parser->payloadSize = getPayloadSize(parser);
+			if (parser->payload[0] == 0 || parser->payload[0] > FULL_LED_ROWS) {
+				++stats->resyncs;
+				parser->state = WAIT_CMD_BYTE;
+				break;
+			}
+		}
+		if (parser->code == SET_PIXEL_TILE_CODE && parser->bytesReceived == 1 && parser->payload[0] >= NUM_PIXEL_TILES) {
+			++stats->resyncs;
+			parser->state = WAIT_CMD_BYTE;
+			break;
+		}
+		if (parser->code == LINK_FRAME_CODE && parser->bytesReceived == LINK_FRAME_FIELDS_SIZE) {
+			parser->payloadSize = getPayloadSize(parser);
+		}
+		if (parser->code == SET_PALETTE_CODE && parser->bytesReceived == 1) {
+			parser->payloadSize = getPayloadSize(parser);
+			if (parser->payload[0] == 0 || parser->payload[0] > MAX_PALETTE_SIZE) {
+				++stats->resyncs;
+				parser->state = WAIT_CMD_BYTE;
+				break;
+			}
+		}
+		if (parser->bytesReceived >= parser->payloadSize) {
+			finishPacket(parser, stats, line, now);
+			parser->state = WAIT_CMD_BYTE;
+		}
+		break;
+	}
+}
+
+void printStats(struct Stats* stats, unsigned long long elapsed) {
+	double seconds = elapsed / 1000000.0;
+	printf(
+		"frames/s: %.1f  bytes/s: %.0f  packets: rows %llu, ranges %llu, full %llu, full ranges %llu, rle %llu, delta %llu, palette %llu, indexed %llu, pong %llu, score %llu, tiles %llu, latch %llu, link frames %llu  resyncs: %llu  link errors: %llu",
+		stats->frames / seconds, stats->bytes / seconds,
+		stats->packets[SET_ROWS_COLOR_CODE], stats->packets[SET_ROW_RANGE_COLOR_CODE],
+		stats->packets[SET_FULL_RES_ROWS_CODE], stats->packets[SET_FULL_RES_RANGE_CODE], stats->packets[SET_FULL_RES_RLE_CODE], stats->packets[SET_FULL_RES_DELTA_CODE],
+		stats->packets[SET_PALETTE_CODE], stats->packets[SET_INDEXED_ROWS_4_CODE] + stats->packets[SET_INDEXED_ROWS_8_CODE],
+		stats->packets[SET_PONG_DATA_CODE], stats->packets[SET_PONG_SCORE_CODE], stats->packets[SET_PIXEL_TILE_CODE], stats->packets[LATCH_FRAME_CODE],
+		stats->packets[LINK_FRAME_CODE], stats->resyncs, stats->linkErrors
+	);
+	if (stats->latencyCount) {
+		printf(
+			"  latency us: min %llu, avg %llu, max %llu",
+			stats->latencyMin, stats->latencyTotal / stats->latencyCount, stats->latencyMax
+		);
+	}
+	printf("\n");
+	fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+	unsigned long baudRate = (argc > 1) ? strtoul(argv[1], NULL, 10) : DEFAULT_BAUD_RATE;
+	unsigned long maxBaudRate = (argc > 2) ? strtoul(argv[2], NULL, 10) : DEFAULT_MAX_BAUD_RATE;
+	unsigned long receiveBufferSize = (argc > 3) ? strtoul(argv[3], NULL, 10) : DEFAULT_RECEIVE_BUFFER_SIZE;
+	unsigned long frameErrorPeriod = (argc > 4) ? strtoul(argv[4], NULL, 10) : 0;
+
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+		printf("ERROR: Failed to create pseudo-terminal\n");
+		return 1;
+	}
+	const char* slaveName = ptsname(master);
+	fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+	// Hold the slave open so the pty survives the controller reconnecting
+	int slave = open(slaveName, O_RDWR | O_NOCTTY);
+	struct termios state;
+	tcgetattr(slave, &state);
+	cfmakeraw(&state);
+	tcsetattr(slave, TCSANOW, &state);
+
+	printf("Fake FPGA listening on %s", slaveName);
+	if (baudRate) {
+		printf(" at %lu baud\n", baudRate);
+	}
+	else {
+		printf(" without rate limit\n");
+	}
+	fflush(stdout);
+
+	struct Parser parser = { 0 };
+	struct Parser frameParser = { 0 };
+	parser.state = WAIT_CMD_BYTE;
+	frameParser.state = WAIT_CMD_BYTE;
+	frameParser.isInFrame = 1;
+	parser.frameParser = receiveBufferSize ? &frameParser : NULL;
+	struct Stats stats;
+	resetStats(&stats);
+
+	unsigned long long reportStartTime = getMicros();
+	struct Line line = { 0 };
+	line.fd = master;
+	line.slave = slave;
+	line.powerOnBaudRate = baudRate;
+	line.maxBaudRate = maxBaudRate;
+	line.isProbed = 1;
+	line.receiveBufferSize = receiveBufferSize;
+	line.frameErrorPeriod = frameErrorPeriod;
+	line.framesUntilError = frameErrorPeriod;
+	line.lastSequence = 0xFF;
+	line.baudRate = baudRate;
+	line.startTime = reportStartTime;
+	uint8_t buffer[READ_CHUNK_SIZE];
+
+	while (1) {
+		updateHostBaudRate(&line);
+		unsigned long long now = getMicros();
+
+		// Only take as many bytes as the emulated line could have carried by now
+		// Without a power-on rate the line is never paced, whatever rate the controller switches to
+		unsigned long pacingBaudRate = line.powerOnBaudRate ? line.baudRate : 0;
+		size_t maxBytes = READ_CHUNK_SIZE;
+		if (pacingBaudRate) {
+			unsigned long long lineBytes = (now - line.startTime) * pacingBaudRate / BITS_PER_BYTE / 1000000;
+			if (lineBytes - line.totalBytes < maxBytes) {
+				maxBytes = (size_t) (lineBytes - line.totalBytes);
+			}
+		}
+
+		if (maxBytes > 0) {
+			ssize_t bytesRead = read(master, buffer, maxBytes);
+			if (bytesRead > 0) {
+				now = getMicros();
+				for (ssize_t i = 0; i < bytesRead; ++i) {
+					unsigned long sentBaudRate = line.hostBaudRate;
+					if (line.lastHostRateBytes) {
+						sentBaudRate = line.lastHostBaudRate;
+						--line.lastHostRateBytes;
+					}
+					if (line.baudRate > line.maxBaudRate) {
+						++stats.resyncs;  // Too fast for this UART, every byte is a framing error
+					}
+					else if (line.baudRate && sentBaudRate != line.baudRate) {
+						++stats.resyncs;  // The two ends disagree on the rate, every byte is a framing error
+					}
+					else {
+						parseByte(&parser, &stats, &line, buffer[i], now);
+					}
+				}
+				stats.bytes += bytesRead;
+				line.totalBytes += bytesRead;
+			}
+			else {
+				// Idle line, don't bank bandwidth for later
+				if (pacingBaudRate) {
+					line.totalBytes = (now - line.startTime) * pacingBaudRate / BITS_PER_BYTE / 1000000;
+				}
+				usleep(1000);
+			}
+		}
+		else {
+			usleep(1000);
+		}
+
+		now = getMicros();
+		if (!line.isProbed && now - line.switchTime >= BAUD_RATE_FALLBACK_MS * 1000ULL) {
+			parser.state = WAIT_CMD_BYTE;
+			line.isProbed = 1;
+			setLineBaudRate(&line, line.powerOnBaudRate ? line.powerOnBaudRate : DEFAULT_BAUD_RATE, now);
+		}
+		if (now - reportStartTime >= REPORT_PERIOD_US) {
+			printStats(&stats, now - reportStartTime);
+			resetStats(&stats);
+			reportStartTime = now;
+		}
+	}
+
+	close(slave);
+	close(master);
+	return 0;
+}